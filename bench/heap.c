@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/heap.h"
+
+/* Times batches of small allocations, as a program building records does them,
+through malloc/free, through the heap with heap_free, and through the heap with
+one heap_release per batch. */
+
+#define BATCH 4096
+#define BATCHES 2000
+
+double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+size_t sizes[BATCH];
+void *ptrs[BATCH];
+volatile long sink = 0;
+
+double time_malloc(void) {
+	double t = now();
+	for( int b = 0; b < BATCHES; b++ ) {
+		for( int i = 0; i < BATCH; i++ ) { ptrs[i] = malloc(sizes[i]); *(long*) ptrs[i] = i; }
+		for( int i = 0; i < BATCH; i++ ) { sink += *(long*) ptrs[i]; free(ptrs[i]); }
+	}
+	return (now() - t) * 1e9 / BATCH / BATCHES;
+}
+
+double time_heap_free(heap *h) {
+	double t = now();
+	for( int b = 0; b < BATCHES; b++ ) {
+		for( int i = 0; i < BATCH; i++ ) { ptrs[i] = heap_alloc(h, sizes[i], i); *(long*) ptrs[i] = i; }
+		for( int i = 0; i < BATCH; i++ ) { sink += *(long*) ptrs[i]; heap_free(h, ptrs[i]); }
+	}
+	return (now() - t) * 1e9 / BATCH / BATCHES;
+}
+
+double time_heap_release(heap *h) {
+	double t = now();
+	for( int b = 0; b < BATCHES; b++ ) {
+		unsigned mark = heap_mark(h);
+		for( int i = 0; i < BATCH; i++ ) { ptrs[i] = heap_alloc(h, sizes[i], i); *(long*) ptrs[i] = i; }
+		for( int i = 0; i < BATCH; i++ ) sink += *(long*) ptrs[i];
+		heap_release(h, mark);
+	}
+	return (now() - t) * 1e9 / BATCH / BATCHES;
+}
+
+int main(void) {
+	static heap h;
+	srand(1);
+	for( int i = 0; i < BATCH; i++ ) sizes[i] = 8 + rand() % 120;
+	printf("%-16s %14s\n", "allocator", "ns/allocation");
+	printf("%-16s %14.1f\n", "malloc/free", time_malloc());
+	printf("%-16s %14.1f\n", "heap/free", time_heap_free(&h));
+	printf("%-16s %14.1f\n", "heap/release", time_heap_release(&h));
+	heap_destroy(&h);
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <time.h>
+#include "../src/lex.h"
+
+/* Throughput of the polishc lexer over a generated source of instructions, numbers,
+strings and labels, read from a regular file so that it is mapped, and the time
+match_instr() takes to resolve an instruction name. */
+
+#define SOURCE_LEN (1 << 24)
+#define RUNS 5
+
+double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+FILE *make_source(size_t *len) {
+	FILE *f = tmpfile();
+	const unsigned names = sizeof(instr_names)/sizeof(*instr_names);
+	size_t n = 0;
+	srand(1);
+	while( n < SOURCE_LEN ) {
+		const char *name;
+		switch( rand() % 8 ) {
+		  case 0:	n += fprintf(f, "%u ", rand() % 100000);				break;
+		  case 1:	n += fprintf(f, "#l%u ", rand());						break;
+		  case 2:	n += fprintf(f, "\"word %u\\n\" ", rand() % 100);		break;
+		  case 3:	n += fprintf(f, "\n:label_%u\n", rand() % 32);			break;
+		  case 4:	n += fprintf(f, "@label_%u ", rand() % 32);				break;
+		  default:
+			while( !*(name = instr_names[1 + rand() % (names - 1)]) || strchr(name, ' ') );
+			n += fprintf(f, "%s ", name);
+		}
+	}
+	fflush(f);
+	*len = n;
+	return f;
+}
+
+volatile int match_sink = 0;
+
+double run_match(void) {
+	const unsigned names = sizeof(instr_names)/sizeof(*instr_names);
+	unsigned lens[sizeof(instr_names)/sizeof(*instr_names)];
+	double best = 1e9;
+	int sink = 0;
+	for( unsigned i = 1; i < names; i++ ) lens[i] = strlen(instr_names[i]);
+	for( int r = 0; r < RUNS; r++ ) {
+		double t = now();
+		for( unsigned k = 0; k < (1 << 20); k++ )
+			for( unsigned i = 1; i < names; i++ ) sink += match_instr(instr_names[i], lens[i]);
+		if( (t = now() - t) < best ) best = t;
+	}
+	match_sink = sink;
+	return best * 1e9 / ((1 << 20) * (double) (names - 1));
+}
+
+int main(void) {
+	size_t len, toks = 0;
+	double best = 1e9;
+	FILE *f = make_source(&len);
+	for( int r = 0; r < RUNS; r++ ) {
+		double t = now();
+		rewind(f);
+		lex l = make_lex(f);
+		for( toks = 0; next_tok(&l); toks++ );
+		free_lex(&l);
+		if( (t = now() - t) < best ) best = t;
+	}
+	printf("%lu bytes, %lu tokens: %.0f MB/s, %.1f Mtok/s\n", len, toks, len / best / 1e6, toks / best / 1e6);
+	printf("match_instr: %.1f ns per name\n", run_match());
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <time.h>
+#include "../src/common.h"
+#include "../src/fmt-lex.h"
+
+/* Throughput of the number parsers behind sscn on comma-separated numeric text,
+against the one-digit-at-a-time generic path and strtoul. */
+
+#define TEXT_LEN (1 << 24)
+#define RUNS 5
+
+double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+char *make_text(const unsigned base, const unsigned max_digits, size_t *len) {
+	char *text = malloc(TEXT_LEN + 32);
+	size_t n = 0;
+	srand(1);
+	while( n < TEXT_LEN ) {
+		unsigned digits = 1 + rand() % max_digits;
+		text[n++] = '1' + rand() % 9;
+		while( --digits ) text[n++] = digit2char(rand() % base);
+		text[n++] = ',';
+	}
+	*len = n;
+	return text;
+}
+
+volatile unsigned long sink = 0;
+
+double run_fmt(const char *text, const size_t len, const unsigned base) {
+	double best = 1e9;
+	for( int r = 0; r < RUNS; r++ ) {
+		const char *p = text, *end = text + len;
+		unsigned long v;
+		double t = now();
+		while( p < end ) { p += fparse_uint(p, end, base, &v) + 1; sink += v; }
+		if( (t = now() - t) < best ) best = t;
+	}
+	return len / best / 1e6;
+}
+
+double run_generic(const char *text, const size_t len, const unsigned base) {
+	double best = 1e9;
+	for( int r = 0; r < RUNS; r++ ) {
+		const char *p = text, *end = text + len;
+		unsigned long v;
+		double t = now();
+		while( p < end ) { p += __fparse_generic(p, end, base, &v) + 1; sink += v; }
+		if( (t = now() - t) < best ) best = t;
+	}
+	return len / best / 1e6;
+}
+
+double run_strtoul(const char *text, const size_t len, const unsigned base) {
+	double best = 1e9;
+	for( int r = 0; r < RUNS; r++ ) {
+		const char *p = text, *end = text + len;
+		char *next;
+		double t = now();
+		while( p < end ) { sink += strtoul(p, &next, base); p = next + 1; }
+		if( (t = now() - t) < best ) best = t;
+	}
+	return len / best / 1e6;
+}
+
+int main(void) {
+	const unsigned bases[] = { 10, 10, 10, 16, 16, 8, 7 };
+	const unsigned digits[] = { 4, 10, 19, 8, 16, 21, 20 };
+	printf("%4s %10s %12s %12s %12s\n", "base", "max digits", "MB/s", "generic", "strtoul");
+	for( unsigned i = 0; i < sizeof(bases)/sizeof(*bases); i++ ) {
+		size_t len;
+		char *text = make_text(bases[i], digits[i], &len);
+		printf("%4u %10u %12.0f %12.0f %12.0f\n", bases[i], digits[i],
+			run_fmt(text, len, bases[i]), run_generic(text, len, bases[i]), run_strtoul(text, len, bases[i]));
+		free(text);
+	}
+	return (int) (sink & 0);
+}
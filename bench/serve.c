@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <sys/wait.h>
+#include "../src/serve.h"
+
+/* Runs bench/echo.pbc on a line of input REQUESTS times, through polish --serve and by
+forking polish for each request, and prints the requests per second of each. Run it
+from the top of the repository after make bench. */
+
+#define REQUESTS 2000
+#define SOCK "/tmp/polish-bench-serve.sock"
+#define PROG "bench/echo.pbc"
+
+const char input[] = "a request for a small script\n";
+
+double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int request(FILE *null) {
+	FILE *in = fmemopen((void*) input, strlen(input), "r");
+	int err = serve_request(SOCK, PROG, in, null);
+	fclose(in);
+	return err;
+}
+
+double time_served(FILE *null) {
+	double t = now();
+	for( int i = 0; i < REQUESTS; i++ ) if( request(null) ) { fprintf(stderr, "Request %d failed.\n", i); exit(1); }
+	return REQUESTS / (now() - t);
+}
+
+double time_forked(int null) {
+	double t = now();
+	for( int i = 0; i < REQUESTS; i++ ) {
+		int in[2], status;
+		if( pipe(in) ) { perror("pipe"); exit(1); }
+		pid_t pid = fork();
+		if( !pid ) {
+			dup2(in[0], 0);
+			dup2(null, 1);
+			close(in[0]);
+			close(in[1]);
+			execl("bin/polish", "polish", PROG, (char*) 0);
+			_exit(127);
+		}
+		close(in[0]);
+		if( write(in[1], input, strlen(input)) < 0 ) perror("write");
+		close(in[1]);
+		waitpid(pid, &status, 0);
+		if( !WIFEXITED(status) || WEXITSTATUS(status) ) { fprintf(stderr, "Request %d failed.\n", i); exit(1); }
+	}
+	return REQUESTS / (now() - t);
+}
+
+int main(void) {
+	FILE *null = fopen("/dev/null", "w");
+	pid_t server = fork();
+	if( !server ) {
+		execl("bin/polish", "polish", "--serve", SOCK, (char*) 0);
+		_exit(127);
+	}
+	/* Waits for the server to listen. */
+	for( int i = 0; request(null) < 0; i++ ) {
+		if( i == 100 ) { fprintf(stderr, "The server didn't start.\n"); return 1; }
+		usleep(10000);
+	}
+	printf("%-16s %14s\n", "requests", "requests/s");
+	printf("%-16s %14.0f\n", "polish --serve", time_served(null));
+	printf("%-16s %14.0f\n", "fork polish", time_forked(fileno(null)));
+	kill(server, SIGTERM);
+	waitpid(server, 0, 0);
+	unlink(SOCK);
+	fclose(null);
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/str-simd.h"
+
+/* Times each string kernel against its scalar version on strings from 8 bytes
+to 8KB; the strings are zero-free so every search runs the whole length. */
+
+#define MAX_LEN 8192
+#define BYTES_PER_RUN (1 << 26)
+
+double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+volatile long sink = 0;
+
+double time_rzero(long (*f)(const char*, size_t), char *p, size_t n) {
+	size_t reps = BYTES_PER_RUN / n;
+	double t = now();
+	for( size_t i = 0; i < reps; i++ ) sink += f(p, n);
+	return (now() - t) * 1e9 / reps;
+}
+
+double time_chr(long (*f)(const char*, size_t, const char), char *p, size_t n) {
+	size_t reps = BYTES_PER_RUN / n;
+	double t = now();
+	for( size_t i = 0; i < reps; i++ ) sink += f(p, n, '#');
+	return (now() - t) * 1e9 / reps;
+}
+
+double time_cmp(int (*f)(const char*, const char*, size_t), char *p, size_t n) {
+	size_t reps = BYTES_PER_RUN / n;
+	double t = now();
+	for( size_t i = 0; i < reps; i++ ) sink += f(p, p + MAX_LEN, n);
+	return (now() - t) * 1e9 / reps;
+}
+
+double time_map(void (*f)(char*, size_t), char *p, size_t n) {
+	size_t reps = BYTES_PER_RUN / n;
+	double t = now();
+	for( size_t i = 0; i < reps; i++ ) f(p, n);
+	return (now() - t) * 1e9 / reps;
+}
+
+int main(void) {
+	char *p = malloc(MAX_LEN), *q = malloc(2*MAX_LEN);
+	for( size_t i = 0; i < MAX_LEN; i++ ) p[i] = 'A' + i % 52;
+	memcpy(q, p, MAX_LEN);
+	memcpy(q + MAX_LEN, p, MAX_LEN);
+	str_simd_init();
+	printf("%-8s %6s %12s %12s %8s\n", "kernel", "bytes", "scalar ns", "simd ns", "speedup");
+	for( size_t n = 8; n <= MAX_LEN; n *= 2 ) {
+		double a, b;
+		a = time_rzero(__str_rzero_scalar, p, n);	b = time_rzero(str_rzero, p, n);
+		printf("%-8s %6lu %12.1f %12.1f %7.1fx\n", "rzero", n, a, b, a / b);
+		a = time_chr(__str_chr_scalar, p, n);		b = time_chr(str_chr, p, n);
+		printf("%-8s %6lu %12.1f %12.1f %7.1fx\n", "chr", n, a, b, a / b);
+		a = time_cmp(__str_cmp_scalar, q, n);		b = time_cmp(str_cmp, q, n);
+		printf("%-8s %6lu %12.1f %12.1f %7.1fx\n", "cmp", n, a, b, a / b);
+		a = time_map(__str_upper_scalar, p, n);		b = time_map(str_upper, p, n);
+		printf("%-8s %6lu %12.1f %12.1f %7.1fx\n", "upper", n, a, b, a / b);
+		a = time_map(__str_lower_scalar, p, n);		b = time_map(str_lower, p, n);
+		printf("%-8s %6lu %12.1f %12.1f %7.1fx\n", "lower", n, a, b, a / b);
+		a = time_map(__str_rev_scalar, p, n);		b = time_map(str_rev, p, n);
+		printf("%-8s %6lu %12.1f %12.1f %7.1fx\n", "rev", n, a, b, a / b);
+	}
+	return (int) (sink & 0);
+}
@@ -0,0 +1,136 @@
+#ifndef _CHAN_H
+#define _CHAN_H
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "pool.h"
+
+/*
+// The channels of chan, send, recv and close: bounded queues of messages of up to a
+// fixed width, which tasks pass to each other without locks. Each slot of the ring has
+// a sequence number which says whose turn it is: the slot of position p is free to the
+// sender which claims p when its sequence is p, and holds the message of p for the
+// receiver which claims p when it is p + 1; the receiver sets it to p + cap. Senders
+// claim positions by compare and swap on tail and receivers on head, so with one
+// sender and one receiver no swap ever fails, and with several they take turns.
+//
+// A receiver finding the channel empty, or a sender finding it full, parks on a futex:
+// receivers on the count of sends, senders on the count of receives, which the other
+// side wakes only if a thread is parked. Unlike join, it does not run other tasks while
+// it waits, as the task it would run may need the one it parks to go on; the pool adds
+// a worker instead if tasks are waiting. close wakes everyone; receivers then drain
+// what was sent before they find the channel closed, and senders fail.
+*/
+typedef struct {
+	unsigned long seq;
+	unsigned long len;
+} chan_slot;
+
+/* tail, head and the futex words are kept a cache line apart. */
+typedef struct {
+	unsigned long cap, width, slot;
+	char pad0[40];
+	unsigned long tail;
+	char pad1[56];
+	unsigned long head;
+	char pad2[56];
+	int sends, recvs, parked, closed;
+	char pad3[48];
+} chan;
+
+unsigned long __chan_cap(const unsigned long cap) {
+	unsigned long c = 1;
+	while( c < cap ) c <<= 1;
+	return c;
+}
+
+unsigned long __chan_slot(const unsigned long width) {
+	return (sizeof(chan_slot) + width + 7) & ~7UL;
+}
+
+/* The bytes a channel of cap messages of up to width bytes takes. */
+size_t chan_size(const unsigned long cap, const unsigned long width) {
+	return sizeof(chan) + __chan_cap(cap)*__chan_slot(width);
+}
+
+chan_slot *__chan_at(chan *c, const unsigned long pos) {
+	return (chan_slot*) ((char*) (c + 1) + (pos & (c->cap - 1))*c->slot);
+}
+
+void chan_init(chan *c, const unsigned long cap, const unsigned long width) {
+	memset(c, 0, sizeof(chan));
+	c->cap = __chan_cap(cap);
+	c->width = width;
+	c->slot = __chan_slot(width);
+	for( unsigned long i = 0; i < c->cap; i++ ) __chan_at(c, i)->seq = i;
+}
+
+void __chan_wake(chan *c, int *word) {
+	__atomic_fetch_add(word, 1, __ATOMIC_SEQ_CST);
+	if( __atomic_load_n(&c->parked, __ATOMIC_SEQ_CST) ) syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+}
+
+/* Waits for the slot at pos to reach seq, or for the channel to close; seen is the
+count of word read before the slot was found not ready. */
+void __chan_park(chan *c, int *word, const int seen, chan_slot *at, const unsigned long seq) {
+	sched_block();
+	__atomic_fetch_add(&c->parked, 1, __ATOMIC_SEQ_CST);
+	if( __atomic_load_n(&at->seq, __ATOMIC_SEQ_CST) != seq && !__atomic_load_n(&c->closed, __ATOMIC_SEQ_CST) )
+		syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, 0, 0, 0);
+	__atomic_fetch_sub(&c->parked, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Sends the len bytes at buf, len being at most the width; returns -1 if the channel
+is closed. */
+int chan_send(chan *c, const void *buf, const unsigned long len) {
+	unsigned long pos;
+	chan_slot *at;
+	for( ;; ) {
+		if( __atomic_load_n(&c->closed, __ATOMIC_SEQ_CST) ) return -1;
+		pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+		at = __chan_at(c, pos);
+		const long d = (long) (__atomic_load_n(&at->seq, __ATOMIC_ACQUIRE) - pos);
+		if( d == 0 && __atomic_compare_exchange_n(&c->tail, &pos, pos + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) break;
+		if( d >= 0 ) continue;
+		const int seen = __atomic_load_n(&c->recvs, __ATOMIC_SEQ_CST);
+		__chan_park(c, &c->recvs, seen, at, pos);
+	}
+	at->len = len;
+	memcpy(at + 1, buf, len);
+	__atomic_store_n(&at->seq, pos + 1, __ATOMIC_RELEASE);
+	__chan_wake(c, &c->sends);
+	return 0;
+}
+
+/* Receives a message into buf, of width bytes, and its length into *len; returns 0
+once the channel is closed and empty. */
+int chan_recv(chan *c, void *buf, unsigned long *len) {
+	unsigned long pos;
+	chan_slot *at;
+	for( ;; ) {
+		pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+		at = __chan_at(c, pos);
+		const long d = (long) (__atomic_load_n(&at->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+		if( d == 0 && __atomic_compare_exchange_n(&c->head, &pos, pos + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) break;
+		if( d >= 0 ) continue;
+		const int seen = __atomic_load_n(&c->sends, __ATOMIC_SEQ_CST);
+		/* A sender may have claimed pos before the close without having filled it yet. */
+		if( __atomic_load_n(&c->closed, __ATOMIC_SEQ_CST) && __atomic_load_n(&c->tail, __ATOMIC_SEQ_CST) == pos ) return 0;
+		__chan_park(c, &c->sends, seen, at, pos + 1);
+	}
+	*len = at->len;
+	memcpy(buf, at + 1, at->len);
+	__atomic_store_n(&at->seq, pos + c->cap, __ATOMIC_RELEASE);
+	__chan_wake(c, &c->recvs);
+	return 1;
+}
+
+void chan_close(chan *c) {
+	__atomic_store_n(&c->closed, 1, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&c->sends, 1, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&c->recvs, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &c->sends, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+	syscall(SYS_futex, &c->recvs, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+}
+
+#endif //_CHAN_H
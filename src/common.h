@@ -29,7 +29,7 @@
 #define F_BASEMASK 0x0000FF00
 #define isalphanum(c) !( (c) < '0' || ((c) > '9' && (c) < 'A') || ((c) > 'Z' && (c) < 'a') || (c) > 'z' )
 
-#define SIZE_TO_MASK(s) (((unsigned long) 1 << 8*(s)) - 1)
+#define SIZE_TO_MASK(s) ((s) >= 8 ? ~0UL : ((unsigned long) 1 << 8*(s)) - 1)
 
 /*
 // Prefixes indicate the number of bytes the objects the instruction operates are.
@@ -52,17 +52,46 @@
 // X->				Xdrp
 // C->				?
 // L->				free, jmp
+// L->				call, pushes the program pointer after it to the return stack
+// ->				ret, jumps to the program pointer popped from the return stack
+// L L->			loop (start, limit), runs the code up to next for each index from start to limit
+// ->L				next, pushes the index past the limit when the loop ends
+// ->L				index, of the innermost loop
+// ... I L->L		spawn, runs the code at L as a task on the top I bytes, which it pops; pushes the task
+// L->...			join, waits for the task L and pushes the stack it left at end
+// I I->L			chan (slots, width), a channel of as many messages of up to width bytes
+// ... I L->		send, pops I bytes as a message to the channel L, waiting while it is full
+// L->... C			recv, waits for a message and pushes its bytes and 1, or 0 once L is closed and empty
+// L->				close
+// L I I L->		pfor (array, width, count, routine), runs the routine on each element in place
 // X->X				Xinc, Xdec
 // C->C				!
 // I->L				alloc
 // L->X				Xget
-// S->S				srev
+// ->L				mark
+// L->				rlse
+// L L I->			mcpy (dest, source, count)
+// L C I->			mset
+// L L I->C			mcmp
+// L I->...			mget, pushes the I bytes at L
+// L ... I->			mput, pops I bytes to L
+// L L I->			Xvadd, Xvsub, Xvmul, Xvcmp (dest, source, count of X elements)
+// L I->X			Xvsum, Xvmin, Xvmax
+// S->S				srev, scap, slow
+// S->S S			sdup
+// S S->S S			sswp
+// S S->S C			scmp
+// S C->S S			stok
+// S I I->S			ssub
 // X->X X			Xdup
 // L X->			Xput, Xputf (X=S)
 // X X->X			Xadd, Xsub, Xmul, Xdiv
 // X X->C			Xcmp,
 // X X->X X			Xswp,
 // ... S->... S:	Sfmt,
+// S S->X... C		sscn
+// ... I->... S		sfmtp, sfmt with the format compiled by polishc at offset I
+// S I->X... C		sscnp, sscn with the format compiled by polishc at offset I
 */
 enum {
 	T_IDEN =	  5,
@@ -82,15 +111,30 @@ enum {
 	T_CMUL =	-45,	T_RMUL =	-46,	T_MUL =		-47,	T_LMUL =	-48,
 	T_CDIV =	-49,	T_RDIV =	-50,	T_DIV =		-51,	T_LDIV =	-52,
 
-	T_SSWP =	-53,	T_SREV =	-54,	T_SSUB =	-55,
-	T_SDRP =	-57,	T_CLSF =	-58,	T_CLS =		-59,
-	T_SDUP =	-61,	T_OPNF =	-62,	T_OPN =		-63,	T_STOK =	-63,
+	T_SSWP =	-53,	T_SREV =	-54,	T_SSUB =	-55,	T_SFMTP =	-56,
+	T_SDRP =	-57,	T_CLSF =	-58,	T_CLS =		-59,	T_SSCNP =	-60,
+	T_SDUP =	-61,	T_OPNF =	-62,	T_OPN =		-63,	T_STOK =	-64,
 	T_SPUT =	-65,	T_SPUTF =	-66,	T_OUT =		-67,	T_SFMT =	-68,
 	T_SGET =	-69,	T_SGETF =	-70,	T_IN =		-71,	T_SSCN =	-72,
 	T_SCMP =	-73,	T_SCAP =	-74,	T_ERR =		-75,	T_SLOW =	-76,
 
-	T_JMP =		-77,	T_CPP =		-78,	T_END =		-79,
+	T_JMP =		-77,	T_CPP =		-78,	T_END =		-79,	T_PFOR =	-80,
 	T_NEW_LABEL = -81,	T_JMP_LABEL = -82,
+	T_MARK =	-83,	T_RLSE =	-84,	T_MCPY =	-85,	T_MSET =	-86,
+	T_MCMP =	-87,	T_MGET =	-88,	T_MPUT =	-89,
+	T_CVADD =	-90,	T_RVADD =	-91,	T_VADD =	-92,	T_LVADD =	-93,
+	T_CVSUB =	-94,	T_RVSUB =	-95,	T_VSUB =	-96,	T_LVSUB =	-97,
+	T_CVMUL =	-98,	T_RVMUL =	-99,	T_VMUL =   -100,	T_LVMUL =  -101,
+	T_CVCMP =  -102,	T_RVCMP =  -103,	T_VCMP =   -104,	T_LVCMP =  -105,
+	T_CVSUM =  -106,	T_RVSUM =  -107,	T_VSUM =   -108,	T_LVSUM =  -109,
+	T_CVMIN =  -110,	T_RVMIN =  -111,	T_VMIN =   -112,	T_LVMIN =  -113,
+	T_CVMAX =  -114,	T_RVMAX =  -115,	T_VMAX =   -116,	T_LVMAX =  -117,
+	T_CALL =   -118,	T_RET =	   -119,	T_SPAWN =  -120,
+	T_LOOP =   -121,	T_NEXT =   -122,	T_INDEX =  -123,
+	T_JOIN =   -124,	T_CHAN =   -125,	T_SEND =   -126,	T_RECV =   -127,
+	T_CLOSE =  -128,
+	/* Tokens of the lexer past the last opcode, -128, which never reach the bytecode. */
+	T_CALL_LABEL = -129,	T_SPAWN_LABEL = -130,	T_PFOR_LABEL = -131,
 
 	T_NOT_LEXED_YET = -500,
 	T_INV_NUMPREF	= -501,
@@ -113,14 +157,27 @@ char *instr_names[] = {
 	"csub",		"rsub",		"sub",		"lsub",
 	"cmul",		"rmul",		"mul",		"lmul",
 	"cdiv",		"rdiv",		"div",		"ldiv",
-	"sswp",		"srev",		"ssub",		"",
-	"sdrp",		"clsf",		"cls",		"",
+	"sswp",		"srev",		"ssub",		"sfmtp",
+	"sdrp",		"clsf",		"cls",		"sscnp",
 	"sdup",		"opnf",		"opn",		"stok",
 	"sput",		"sputf",	"out",		"sfmt",
 	"sget",		"sgetf",	"in",		"sscn",
 	"scmp",		"scap",		"err",		"slow",
-	"jmp",  	"cpp",  	"end",		"",
+	"jmp",  	"cpp",  	"end",		"pfor",
 	"new label","jmp label",
+	"mark",		"rlse",		"mcpy",		"mset",
+	"mcmp",		"mget",		"mput",
+	"cvadd",	"rvadd",	"vadd",		"lvadd",
+	"cvsub",	"rvsub",	"vsub",		"lvsub",
+	"cvmul",	"rvmul",	"vmul",		"lvmul",
+	"cvcmp",	"rvcmp",	"vcmp",		"lvcmp",
+	"cvsum",	"rvsum",	"vsum",		"lvsum",
+	"cvmin",	"rvmin",	"vmin",		"lvmin",
+	"cvmax",	"rvmax",	"vmax",		"lvmax",
+	"call",		"ret",		"spawn",
+	"loop",		"next",		"index",
+	"join",		"chan",		"send",		"recv",
+	"close",	"call label", "spawn label", "pfor label",
 };
 
 enum { /* COMPILATION ERRORS */
@@ -131,7 +188,6 @@ enum { /* COMPILATION ERRORS */
 	ERR_EOF = 5,
 	ERR_LABELREDEF = 6,
 	ERR_LABELUNDEF = 7,
-	ERR_LABELCHAROVERFLOW = 8,
 };
 
 const char *err_notify = "CMPL ERR: ";
@@ -139,11 +195,10 @@ const char *err_strs[] = {
 	"Program stack overflow; ",
 	"Overlarge number for type; ",
 	"Invalid token; ",
-	"Unknown instruction %s; ",
+	"Unknown instruction; ",
 	"Program leaves valid memory before END; ",
 	"Label redefinition; ",
 	"No label matching ",
-	"Total label length exceeds buffer; ",
 };
 
 enum { /* RUNTIME ERRORS */
@@ -155,6 +210,9 @@ enum { /* RUNTIME ERRORS */
 	RERR_RUNAWAYSTR = 6,
 	RERR_STRGET = 7,
 	RERR_INVFMT = 8,
+	RERR_INVMARK = 9,
+	RERR_NOMEM = 10,
+	RERR_CHAN = 11,
 };
 
 const char *rerr_notify = "RUN ERR: ";
@@ -167,9 +225,13 @@ const char *rerr_strs[] = {
 	"Runaway string; ",
 	"Error reading string; ",
 	"Invalid format string; ",
+	"Invalid heap mark; ",
+	"Heap exhausted; ",
+	"Channel error; ",
 };
 
-char err_extra[ERR_EXTRA_LEN] = {0};
+/* Per thread, as get_num() runs in every VM; each VM keeps its own copy. */
+_Thread_local char err_extra[ERR_EXTRA_LEN] = {0};
 
 typedef struct {
 	void *data;
@@ -7,6 +7,9 @@ enum {
 	FMT_INT = -4,
 	FMT_LONG = -5,
 	FMT_INV = -6,
+	FMT_LIT = -7,
+	FMT_WS = -8,
+	FMT_END = -9,
 };
 
 enum {
@@ -93,97 +96,305 @@ int next_token_fmt(fmt_lex *l) {
 //	printf("FMTLEXER: Formatting mark found: %c!\n", c);
 	c = __advance_fmt(l);
 	switch( c ) {
-	  case '%':		return '%';
+	  case '%':		__advance_fmt(l);	return '%';
 	  default:	return parse_fmt(l);
 	}
 }
 
+/* A format string compiled by polishc is a sequence of fmt_op ended by FMT_END:
+a directive keeps the state its lexer had, FMT_LIT is followed by its width
+characters, padded to a whole fmt_op, and FMT_WS matches any whitespace in sscn. */
+typedef struct {
+	signed char tok;
+	char sign;
+	char base;
+	char padding;
+	int width;
+} fmt_op;
+
+#define FMT_LIT_SIZE(n) (((n) + sizeof(fmt_op) - 1) / sizeof(fmt_op) * sizeof(fmt_op))
+
+/* Compiles the len characters at c, followed by a zero, into out, which must have
+room for 2*sizeof(fmt_op)*(len + 1) bytes; a format for sscn gets FMT_WS ops for
+its whitespace. Returns the size of the program, or 0 for an invalid directive. */
+size_t fmt_compile(char *c, const size_t len, const int scan, char *out) {
+	fmt_lex l = make_fmt_lex(c);
+	fmt_op *lit = 0;
+	size_t n = 0;
+	int tok, ws = 0;
+	while( l.c < c + len ) {
+		tok = next_token_fmt(&l);
+		if( tok == FMT_INV )												return 0;
+		if( tok >= 0 && !(scan && isspace(tok)) ) {
+			if( !lit ) {
+				lit = (fmt_op*) (out + n);
+				*lit = (fmt_op) { FMT_LIT, 0, 0, 0, 0 };
+				n += sizeof(fmt_op);
+			}
+			out[n + lit->width++] = tok;
+			ws = 0;
+			continue;
+		}
+		if( lit ) {
+			memset(out + n + lit->width, 0, FMT_LIT_SIZE(lit->width) - lit->width);
+			n += FMT_LIT_SIZE(lit->width);
+			lit = 0;
+		}
+		if( tok >= 0 && ws ) continue;
+		ws = tok >= 0;
+		*(fmt_op*) (out + n) = (fmt_op) { ws ? FMT_WS : tok, l.sign, l.base, l.padding, l.width };
+		n += sizeof(fmt_op);
+	}
+	if( lit ) {
+		memset(out + n + lit->width, 0, FMT_LIT_SIZE(lit->width) - lit->width);
+		n += FMT_LIT_SIZE(lit->width);
+	}
+	*(fmt_op*) (out + n) = (fmt_op) { FMT_END, 0, 0, 0, 0 };
+	return n + sizeof(fmt_op);
+}
+
 char digit2char(unsigned char digit) {
 	if( digit < 10 )return '0' + digit;
 	else 			return 'A' + digit - 10;
 }
 
-unsigned char fmt_num_width_prep(fmt_lex *l, unsigned long *num, const unsigned size, unsigned long *significand, char *prefix) {
-	unsigned long abs = SIZE_TO_MASK(size) & *num;
-	unsigned char width = 1;
+const char fmt_digit_chars[] = "0123456789ABCDEFGHIJ";
+
+const char fmt_digit_pairs[] =
+	"00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859" "60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+const unsigned long fmt_pow10[] = {
+	1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL,
+	1000000000UL, 10000000000UL, 100000000000UL, 1000000000000UL, 10000000000000UL,
+	100000000000000UL, 1000000000000000UL, 10000000000000000UL, 100000000000000000UL,
+	1000000000000000000UL, 10000000000000000000UL,
+};
+
+/* log2 of the base for bases 2, 4, 8 and 16, otherwise 0 */
+unsigned char fmt_base_shift(const unsigned base) {
+	switch( base ) {
+	  case 2: return 1;	  case 4: return 2;	  case 8: return 3;	  case 16: return 4;
+	  default: return 0;
+	}
+}
+
+/* Number of digits of abs in the base; a unary number has abs digits. Base 10 estimates
+the count from the bit length (1233/4096 ~ log10(2)) and corrects it with one compare. */
+unsigned fmt_num_digits(unsigned long abs, const unsigned base) {
+	unsigned bits = 64 - __builtin_clzl(abs | 1), shift, count;
+	if( abs == 0 )							return base != 1;
+	if( base == 10 ) {
+		count = (bits * 1233) >> 12;
+		return count + (abs >= fmt_pow10[count]);
+	}
+	if( (shift = fmt_base_shift(base)) )	return (bits + shift - 1) / shift;
+	if( base == 1 )							return abs;
+	for( count = 1; abs >= base; count++ ) abs /= base;
+	return count;
+}
+
+unsigned fmt_num_width_prep(fmt_lex *l, unsigned long *num, const unsigned size, unsigned *digits, char *prefix) {
+	const unsigned long mask = SIZE_TO_MASK(size), sign = 1UL << (8*size - 1);
+	unsigned long abs = mask & *num;
+	unsigned width = 0;
 	*prefix = 0;
 	switch( l->sign ) {
 	  case SIGN_S:
-	  	if( abs & (1 << (8*size - 1)) ) {
-			abs = ~(SIZE_TO_MASK(size) & (abs - 1));
-			*prefix = '-'; width = 2;
+	  	if( abs & sign ) {
+			abs = mask & -abs;
+			*prefix = '-'; width = 1;
 	  	} break;
 	  case SIGN_SSHOW:
-	  	width = 2;
-		if( abs & (1 << (8*size - 1)) ) {
-			abs = ~(SIZE_TO_MASK(size) & (abs - 1));
+	  	width = 1;
+		if( abs & sign ) {
+			abs = mask & -abs;
 			*prefix = '-';
 		} else *prefix = '+';
 		break;
-	  case SIGN_USHOW: width = 2; *prefix = '+';
+	  case SIGN_USHOW: width = 1; *prefix = '+';
 	}
-	*significand = l->base;
-	while( *significand <= abs ) { *significand *= l->base; width++; }
+	*digits = fmt_num_digits(abs, l->base);
+	width += *digits;
 	if( l->width == -1 ) l->width = width;
-	*significand /= l->base;
 	*num = abs;
 	return width;
 }
 
-void fmt_num(const fmt_lex *l, char *out, unsigned long abs, unsigned char width, unsigned long significand, const char prefix) {
-	unsigned char digit = 0;
-	while( width < l->width ) { *out = l->padding; out++; width++; }
+/* Writes the padding, prefix and digits of a number prepared by fmt_num_width_prep();
+the digits are written from the least significant up: base 10 two at a time from a
+table, bases 2, 4, 8 and 16 by shift and mask, other bases by one division each. */
+void fmt_num(const fmt_lex *l, char *out, unsigned long abs, unsigned width, const unsigned digits, const char prefix) {
+	unsigned shift;
+	unsigned long q;
+	if( width < (unsigned) l->width ) { memset(out, l->padding, l->width - width); out += l->width - width; }
 	if( prefix ) { *out = prefix; out++; }
-	for( ;; ) {
-		digit = abs / significand;
-		*out = digit2char(digit); out++;
-		abs -= digit * significand;
-		if( significand == 1 ) break;
-		significand /= l->base;
+	char *p = out + digits;
+	if( l->base == 10 ) {
+		while( abs >= 100 ) {
+			q = abs / 100;
+			p -= 2; memcpy(p, fmt_digit_pairs + 2*(abs - 100*q), 2);
+			abs = q;
+		}
+		if( abs >= 10 ) { p -= 2; memcpy(p, fmt_digit_pairs + 2*abs, 2); }
+		else *--p = '0' + abs;
+	}
+	else if( (shift = fmt_base_shift(l->base)) ) {
+		const unsigned long mask = l->base - 1;
+		while( p > out ) { *--p = fmt_digit_chars[abs & mask]; abs >>= shift; }
+	}
+	else if( l->base == 1 ) memset(out, '1', digits);
+	else {
+		while( p > out ) {
+			q = abs / l->base;
+			*--p = digit2char(abs - q*l->base);
+			abs = q;
+		}
+	}
+}
+
+/* fmt_digit_vals[c] is one more than the value of the digit c in bases up to 20,
+or 0 if c is not such a digit, so that one compare checks a digit against any base. */
+const unsigned char fmt_digit_vals[256] = {
+	['0'] = 1,	['1'] = 2,	['2'] = 3,	['3'] = 4,	['4'] = 5,
+	['5'] = 6,	['6'] = 7,	['7'] = 8,	['8'] = 9,	['9'] = 10,
+	['a'] = 11,	['b'] = 12,	['c'] = 13,	['d'] = 14,	['e'] = 15,
+	['f'] = 16,	['g'] = 17,	['h'] = 18,	['i'] = 19,	['j'] = 20,
+	['A'] = 11,	['B'] = 12,	['C'] = 13,	['D'] = 14,	['E'] = 15,
+	['F'] = 16,	['G'] = 17,	['H'] = 18,	['I'] = 19,	['J'] = 20,
+};
+
+#define SWAR_ONES 0x0101010101010101UL
+#define SWAR_HIGH 0x8080808080808080UL
+
+/* The high bit of every byte of w that lies in [lo, hi), for 0 < lo <= hi < 0x80;
+adding to the low 7 bits of each byte cannot carry into the next byte. */
+unsigned long __swar_in_range(const unsigned long w, const unsigned char lo, const unsigned char hi) {
+	const unsigned long low7 = w & ~SWAR_HIGH;
+	return (low7 + SWAR_ONES*(0x80 - lo)) & ~(low7 + SWAR_ONES*(0x80 - hi)) & ~w & SWAR_HIGH;
+}
+
+/* Number of leading bytes of w, in memory order, with their high bit set in valid */
+unsigned __swar_run(const unsigned long valid) {
+	const unsigned long invalid = ~valid & SWAR_HIGH;
+	return invalid ? __builtin_ctzl(invalid) >> 3 : 8;
+}
+
+/* Value of the 8 decimal digits in w, first digit in the lowest byte: subtract '0'
+from every byte, then combine neighbouring digits, pairs and quadruples. */
+unsigned long __swar_dec8(unsigned long w) {
+	w -= SWAR_ONES*'0';
+	w = w*10 + (w >> 8);
+	return (((w & 0x000000FF000000FFUL) * (100 + (1000000UL << 32)))
+		+ (((w >> 16) & 0x000000FF000000FFUL) * (1 + (10000UL << 32)))) >> 32;
+}
+
+/* Value of the 8 hex digits in w, first digit in the lowest byte: letters have bit 6
+set and their low nibble is 9 less than their value; the nibbles are then packed. */
+unsigned long __swar_hex8(unsigned long w) {
+	const unsigned long letters = (w >> 6) & SWAR_ONES;
+	w = __builtin_bswap64((w & SWAR_ONES*0x0F) + (letters << 3) + letters);
+	w = (w | w >> 4) & 0x00FF00FF00FF00FFUL;
+	w = (w | w >> 8) & 0x0000FFFF0000FFFFUL;
+	return (w | w >> 16) & 0xFFFFFFFFUL;
+}
+
+/* Decimal and hex numbers are read 8 digits at a time while 8 bytes remain before end:
+the digits are found with SWAR range checks and, when fewer than 8, shifted to the top
+of the word so that the bytes below read as leading zeros. */
+size_t __fparse_dec(const char *p, const char *end, unsigned long *val) {
+	unsigned long v = 0, w;
+	unsigned char d;
+	unsigned k;
+	size_t n = 0;
+	while( end - (p + n) >= 8 ) {
+		memcpy(&w, p + n, 8);
+		k = __swar_run(__swar_in_range(w, '0', '9' + 1));
+		if( k == 8 ) { v = v*100000000UL + __swar_dec8(w); n += 8; continue; }
+		if( k ) v = v*fmt_pow10[k] + __swar_dec8(w << 8*(8 - k) | (SWAR_ONES*'0') >> 8*k);
+		*val = v;
+		return n + k;
+	}
+	while( p + n < end && (d = p[n] - '0') < 10 ) { v = v*10 + d; n++; }
+	*val = v;
+	return n;
+}
+
+size_t __fparse_hex(const char *p, const char *end, unsigned long *val) {
+	unsigned long v = 0, w;
+	unsigned char d;
+	unsigned k;
+	size_t n = 0;
+	while( end - (p + n) >= 8 ) {
+		memcpy(&w, p + n, 8);
+		k = __swar_run(__swar_in_range(w, '0', '9' + 1) | __swar_in_range(w | SWAR_ONES*0x20, 'a', 'f' + 1));
+		if( k == 8 ) { v = v << 32 | __swar_hex8(w); n += 8; continue; }
+		if( k ) v = v << 4*k | __swar_hex8(w << 8*(8 - k) | (SWAR_ONES*'0') >> 8*k);
+		*val = v;
+		return n + k;
 	}
+	while( p + n < end && (d = fmt_digit_vals[(unsigned char) p[n]] - 1) < 16 ) { v = v << 4 | d; n++; }
+	*val = v;
+	return n;
+}
+
+size_t __fparse_pow2(const char *p, const char *end, const unsigned shift, unsigned long *val) {
+	const unsigned char base = 1 << shift;
+	unsigned long v = 0;
+	unsigned char d;
+	size_t n = 0;
+	while( p + n < end && (d = fmt_digit_vals[(unsigned char) p[n]] - 1) < base ) { v = v << shift | d; n++; }
+	*val = v;
+	return n;
 }
 
-int fparse_num(const fmt_lex *l, char *in, size_t *ptr, t_lnum *numval) {
+size_t __fparse_generic(const char *p, const char *end, const unsigned base, unsigned long *val) {
+	unsigned long v = 0;
+	unsigned char d;
+	size_t n = 0;
+	while( p + n < end && (d = fmt_digit_vals[(unsigned char) p[n]] - 1) < base ) { v = v*base + d; n++; }
+	*val = v;
+	return n;
+}
+
+/* Parses an unsigned number in the base from [p, end); returns the number of digits read. */
+size_t fparse_uint(const char *p, const char *end, const unsigned base, unsigned long *val) {
+	unsigned shift;
+	size_t n = 0;
+	if( base == 10 )							return __fparse_dec(p, end, val);
+	if( base == 16 )							return __fparse_hex(p, end, val);
+	if( (shift = fmt_base_shift(base)) )		return __fparse_pow2(p, end, shift, val);
+	if( base != 1 )								return __fparse_generic(p, end, base, val);
+	while( p + n < end && p[n] == '1' ) n++;
+	*val = n;
+	return n;
+}
+
+/* Parses a number as directed by the format lexer from *in, reading no further than end
+or the field width, and advances *in past it. Returns 1 if there is no number. */
+int fparse_num(const fmt_lex *l, const char **in, const char *end, t_lnum *numval) {
+	const char *p = *in;
 	char negative = 0;
-	size_t delta = 0;
+	if( l->width != -1 && end - p > l->width ) end = p + l->width;
+	while( p < end && *p == l->padding ) p++;
 	switch( l->sign ) {
 	  case SIGN_S:
-		if( *(in + *ptr + delta) == '-' ) { negative = 1; delta++; }
+		if( p < end && *p == '-' ) { negative = 1; p++; }
+		else if( p < end && *p == '+' ) p++;
 		break;
 	  case SIGN_SSHOW:
-		if( *(in + *ptr + delta) == '-' ) { negative = 1; delta++; }
-		else if( *(in + *ptr + delta) == '+' ) delta++;
+		if( p < end && *p == '-' ) { negative = 1; p++; }
+		else if( p < end && *p == '+' ) p++;
 		else return 1;
 		break;
 	  case SIGN_USHOW:
-		if( *(in + delta) != '+' ) { return 1; }
-	}
-	*numval = 0;
-	if( l->base == 1 ) {
-		while( delta < (unsigned long) l->width && *(in + *ptr + delta) == l->padding ) { delta++; };
-		while( delta < (unsigned long) l->width && *(in + *ptr + delta) == '1' ) { (*numval)++; delta++; }
-		if( delta < (unsigned long) l->width && l->width != -1 ) return 1;
-		if( negative ) { *numval = (*numval - 1) ^ 0xFFFFFFFFFFFFFFFF; }
-		*ptr += delta;
-		return 0;
-	}
-	char curr_char = 0;
-	while( delta < (unsigned long) l->width && *(in + *ptr + delta) == l->padding ) { delta++; }
-	while( delta < (unsigned long) l->width ) {
-		curr_char = *(in + *ptr + delta++);
-		if( curr_char >= '0' && curr_char <= '9' && curr_char < l->base ) {
-			curr_char *= l->base;
-			curr_char += curr_char - '0';
-		} else if( curr_char >= 'a' && curr_char < 'a' + l->base - 10 ) {
-			curr_char *= l->base;
-			curr_char += curr_char - 'a' + 10;
-		} else if( curr_char >= 'A' && curr_char < 'A' + l->base - 10 ) {
-			curr_char *= l->base;
-			curr_char += curr_char - 'A' + 10;
-		} else if( l->width == -1 ) break;
+		if( p < end && *p == '+' ) p++;
 		else return 1;
 	}
-	if( negative ) { *numval = (*numval - 1) ^ 0xFFFFFFFFFFFFFFFF; }
-	*ptr += delta;
+	size_t n = fparse_uint(p, end, l->base, numval);
+	if( n == 0 && l->base != 1 ) return 1;
+	if( negative ) *numval = -*numval;
+	*in = p + n;
 	return 0;
 }
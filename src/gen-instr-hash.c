@@ -0,0 +1,59 @@
+#include "common.h"
+
+/* Writes src/instr-hash.h, the perfect hash from instruction names to tokens that
+match_instr() looks identifiers up in. Each name is packed into a word, first
+character lowest, and hashed by a multiply and a shift; multipliers from a fixed
+sequence are tried, for tables of growing size, until no two names share a slot.
+sfmtp and sscnp are left out: polishc emits them, they are not written by hand. */
+
+#define NAMES (sizeof(instr_names)/sizeof(*instr_names))
+#define TRIES (1 << 20)
+
+int lexable(const unsigned i) {
+	return *instr_names[i] && !strchr(instr_names[i], ' ') && i != -T_SFMTP && i != -T_SSCNP;
+}
+
+int main(void) {
+	unsigned long keys[NAMES] = {0}, table[1 << 16], x = 0x9E3779B97F4A7C15UL, mul = 0;
+	unsigned char slot_tok[1 << 16];
+	unsigned maxlen = 0, bits = 0, i, tries;
+	for( i = 1; i < NAMES; i++ ) {
+		if( !lexable(i) ) continue;
+		if( strlen(instr_names[i]) > sizeof(unsigned long) ) {
+			fprintf(stderr, "gen-instr-hash: %s is longer than a word\n", instr_names[i]);
+			return 1;
+		}
+		if( strlen(instr_names[i]) > maxlen ) maxlen = strlen(instr_names[i]);
+		for( unsigned j = strlen(instr_names[i]); j--; ) keys[i] = keys[i] << 8 | (unsigned char) instr_names[i][j];
+	}
+	for( bits = 6; bits <= 16; bits++ ) {
+		for( tries = 0; tries < TRIES; tries++ ) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			mul = x | 1;
+			memset(table, 0, sizeof(unsigned long) << bits);
+			for( i = 1; i < NAMES; i++ ) {
+				if( !keys[i] ) continue;
+				unsigned h = keys[i] * mul >> (64 - bits);
+				if( table[h] ) break;
+				table[h] = keys[i];
+				slot_tok[h] = i;
+			}
+			if( i == NAMES ) goto found;
+		}
+	}
+	fprintf(stderr, "gen-instr-hash: no perfect hash found\n");
+	return 1;
+found:
+	printf("/* Generated by src/gen-instr-hash.c from instr_names in src/common.h; do not edit. */\n");
+	printf("#define INSTR_HASH_MUL 0x%016lXUL\n", mul);
+	printf("#define INSTR_HASH_SHIFT %u\n", 64 - bits);
+	printf("#define INSTR_HASH_MAXLEN %u\n\n", maxlen);
+	printf("const unsigned long instr_hash_keys[%u] = {", 1 << bits);
+	for( i = 0; i < 1U << bits; i++ )
+		printf("%s0x%lX,", i % 4 ? " " : "\n\t", table[i]);
+	printf("\n};\n\nconst signed char instr_hash_toks[%u] = {", 1 << bits);
+	for( i = 0; i < 1U << bits; i++ )
+		printf("%s%4d,", i % 8 ? " " : "\n\t", table[i] ? -(int) slot_tok[i] : T_IDEN);
+	printf("\n};\n");
+	return 0;
+}
@@ -0,0 +1,272 @@
+#ifndef _HEAP_H
+#define _HEAP_H
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+// The heap behind opn and cls. Blocks of up to HEAP_MAX_BLOCK bytes are rounded up
+// to a power of two size class and cut from a bump arena of HEAP_CHUNK byte chunks;
+// freed blocks go onto a free list for their class and are reused before the arena
+// is bumped again. Larger blocks come from malloc and are kept in a list.
+//
+// heap_mark() starts a new level of the heap and returns it; heap_release() drops
+// every block allocated since that level was started by resetting the arena to
+// where it was, whatever the number of blocks, though blocks from malloc are freed
+// one by one. Each level has its own free lists, so that no block handed out after
+// a mark comes from memory that outlives the release of the mark.
+//
+// heap_destroy() frees everything the heap holds at once.
+//
+// A heap is not thread-safe. The tasks a VM spawns use its heap under one mutex of
+// the VM, see src/vm.h, rather than caches of blocks per thread: a block a task kept
+// back could belong to a level that another task releases. Tasks which allocate in
+// parallel therefore take turns at the lock.
+//
+// With a heap_stats attached the heap counts live, peak and reserved bytes and
+// allocations per size and per allocation site, and refuses allocations that would
+// take the live bytes over the cap. To keep the counts right heap_release() then
+// walks the blocks it drops, which makes it linear in their number.
+*/
+#define HEAP_MIN_SHIFT 4
+#define HEAP_CLASSES 8
+#define HEAP_MAX_BLOCK (1UL << (HEAP_MIN_SHIFT + HEAP_CLASSES - 1))
+#define HEAP_LARGE HEAP_CLASSES
+#define HEAP_CHUNK (1UL << 16)
+#define HEAP_MAX_MARKS 64
+#define HEAP_FREED 0x100
+
+/* Header in front of every block; the free list link overlays the payload. The size
+is the one asked for and the site is given by the caller, for heap_stats. */
+typedef struct {
+	unsigned cls;
+	unsigned level;
+	unsigned size;
+	unsigned site;
+} heap_block;
+
+typedef struct heap_large {
+	struct heap_large *prev, *next;
+	heap_block b;
+} heap_large;
+
+typedef struct heap_chunk {
+	struct heap_chunk *prev;
+	char *fill;
+} heap_chunk;
+
+typedef struct {
+	unsigned site;
+	unsigned long allocs, bytes, live;
+} heap_site;
+
+typedef struct {
+	size_t live, peak, reserved, peak_reserved, cap;
+	unsigned long allocs, frees, refused;
+	unsigned long sizes[65];
+	heap_site *sites;
+	size_t site_count, site_cap;
+} heap_stats;
+
+typedef struct {
+	heap_chunk *chunk;
+	char *top;
+	void *free[HEAP_CLASSES];
+	heap_large *large;
+} heap_level;
+
+typedef struct {
+	heap_level levels[HEAP_MAX_MARKS + 1];
+	unsigned level;
+	heap_chunk *chunk, *spare;
+	char *top, *end;
+	heap_stats *stats;
+} heap;
+
+/* Sites are kept in an open addressing table keyed by site + 1. */
+heap_site *__heap_site(heap_stats *st, const unsigned site) {
+	size_t i, mask;
+	if( 2*(st->site_count + 1) > st->site_cap ) {
+		heap_site *old = st->sites;
+		size_t old_cap = st->site_cap;
+		st->site_cap = old_cap ? 2*old_cap : 64;
+		st->sites = calloc(st->site_cap, sizeof(heap_site));
+		for( size_t j = 0; j < old_cap; j++ ) {
+			if( !old[j].site ) continue;
+			for( i = old[j].site & (st->site_cap - 1); st->sites[i].site; i = (i + 1) & (st->site_cap - 1) );
+			st->sites[i] = old[j];
+		}
+		free(old);
+	}
+	mask = st->site_cap - 1;
+	for( i = (site + 1) & mask; st->sites[i].site && st->sites[i].site != site + 1; i = (i + 1) & mask );
+	if( !st->sites[i].site ) { st->sites[i].site = site + 1; st->site_count++; }
+	return st->sites + i;
+}
+
+void __heap_count_alloc(heap_stats *st, const heap_block *b) {
+	heap_site *site = __heap_site(st, b->site);
+	st->live += b->size;
+	if( st->live > st->peak ) st->peak = st->live;
+	st->allocs++;
+	st->sizes[b->size ? 64 - __builtin_clzl(b->size) : 0]++;
+	site->allocs++;
+	site->bytes += b->size;
+	site->live += b->size;
+}
+
+void __heap_count_free(heap_stats *st, const heap_block *b) {
+	st->live -= b->size;
+	st->frees++;
+	__heap_site(st, b->site)->live -= b->size;
+}
+
+void __heap_reserve(heap_stats *st, const long bytes) {
+	st->reserved += bytes;
+	if( st->reserved > st->peak_reserved ) st->peak_reserved = st->reserved;
+}
+
+unsigned heap_class(const size_t size) {
+	if( size <= 1UL << HEAP_MIN_SHIFT ) return 0;
+	return 64 - __builtin_clzl(size - 1) - HEAP_MIN_SHIFT;
+}
+
+int __heap_grow(heap *h) {
+	heap_chunk *c = h->spare;
+	if( c )	h->spare = c->prev;
+	else if( !(c = malloc(HEAP_CHUNK)) ) return 1;
+	else if( h->stats ) __heap_reserve(h->stats, HEAP_CHUNK);
+	if( h->chunk ) h->chunk->fill = h->top;
+	c->prev = h->chunk;
+	h->chunk = c;
+	h->top = (char*) (c + 1);
+	h->end = (char*) c + HEAP_CHUNK;
+	return 0;
+}
+
+heap_block *__heap_alloc_large(heap *h, const size_t size) {
+	heap_level *lv = h->levels + h->level;
+	heap_large *l = malloc(sizeof(heap_large) + size);
+	if( !l ) return 0;
+	if( h->stats ) __heap_reserve(h->stats, sizeof(heap_large) + size);
+	l->prev = 0;
+	if( (l->next = lv->large) ) l->next->prev = l;
+	lv->large = l;
+	l->b.cls = HEAP_LARGE;
+	return &l->b;
+}
+
+/* Returns 0 if out of memory, or with heap_stats, if the cap would be exceeded. */
+void *heap_alloc(heap *h, const size_t size, const unsigned site) {
+	heap_block *b;
+	if( h->stats && h->stats->cap && size > h->stats->cap - h->stats->live ) {
+		h->stats->refused++;
+		return 0;
+	}
+	if( size > HEAP_MAX_BLOCK ) {
+		if( !(b = __heap_alloc_large(h, size)) ) return 0;
+	} else {
+		const unsigned cls = heap_class(size);
+		const size_t need = sizeof(heap_block) + (1UL << (HEAP_MIN_SHIFT + cls));
+		heap_level *lv = h->levels + h->level;
+		if( lv->free[cls] ) {
+			b = (heap_block*) lv->free[cls] - 1;
+			lv->free[cls] = *(void**) lv->free[cls];
+		} else {
+			if( (size_t) (h->end - h->top) < need && __heap_grow(h) ) return 0;
+			b = (heap_block*) h->top;
+			h->top += need;
+		}
+		b->cls = cls;
+	}
+	b->level = h->level;
+	b->size = size;
+	b->site = site;
+	if( h->stats ) __heap_count_alloc(h->stats, b);
+	return b + 1;
+}
+
+void heap_free(heap *h, void *p) {
+	if( !p ) return;
+	heap_block *b = (heap_block*) p - 1;
+	heap_level *lv = h->levels + b->level;
+	if( h->stats ) __heap_count_free(h->stats, b);
+	if( b->cls != HEAP_LARGE ) {
+		*(void**) p = lv->free[b->cls];
+		lv->free[b->cls] = p;
+		b->cls |= HEAP_FREED;
+		return;
+	}
+	heap_large *l = (heap_large*) ((char*) b - offsetof(heap_large, b));
+	if( l->next ) l->next->prev = l->prev;
+	if( l->prev ) l->prev->next = l->next;
+	else lv->large = l->next;
+	if( h->stats ) __heap_reserve(h->stats, -(long) (sizeof(heap_large) + b->size));
+	free(l);
+}
+
+/* Returns the new level, or 0 if there are HEAP_MAX_MARKS marks already. */
+unsigned heap_mark(heap *h) {
+	if( h->level == HEAP_MAX_MARKS ) return 0;
+	heap_level *lv = h->levels + ++h->level;
+	*lv = (heap_level) { h->chunk, h->top, {0}, 0 };
+	return h->level;
+}
+
+void __heap_free_large(heap *h, heap_level *lv) {
+	heap_large *l = lv->large, *next;
+	for( ; l; l = next ) {
+		next = l->next;
+		if( h->stats ) {
+			__heap_count_free(h->stats, &l->b);
+			__heap_reserve(h->stats, -(long) (sizeof(heap_large) + l->b.size));
+		}
+		free(l);
+	}
+	lv->large = 0;
+}
+
+/* Counts as freed the live blocks in the arena from top in chunk stop up to the head. */
+void __heap_count_release(heap *h, heap_chunk *stop, char *top) {
+	heap_block *b;
+	for( heap_chunk *c = h->chunk; c; c = c->prev ) {
+		char *p = c == stop ? top : (char*) (c + 1), *end = c == h->chunk ? h->top : c->fill;
+		for( ; p < end; p += sizeof(heap_block) + (1UL << (HEAP_MIN_SHIFT + (b->cls & ~HEAP_FREED))) ) {
+			b = (heap_block*) p;
+			if( !(b->cls & HEAP_FREED) ) __heap_count_free(h->stats, b);
+		}
+		if( c == stop ) break;
+	}
+}
+
+/* Drops the blocks of level and of every level above it; returns 1 if level is
+not a current mark. Chunks emptied by the release are kept for reuse. */
+int heap_release(heap *h, const unsigned level) {
+	if( level == 0 || level > h->level ) return 1;
+	heap_level *lv = h->levels + level;
+	heap_chunk *c;
+	if( h->stats ) __heap_count_release(h, lv->chunk, lv->top);
+	for( ; h->level >= level; h->level-- ) __heap_free_large(h, h->levels + h->level);
+	while( h->chunk != lv->chunk ) {
+		c = h->chunk;
+		h->chunk = c->prev;
+		c->prev = h->spare;
+		h->spare = c;
+	}
+	h->top = lv->top;
+	h->end = h->chunk ? (char*) h->chunk + HEAP_CHUNK : 0;
+	return 0;
+}
+
+void heap_destroy(heap *h) {
+	heap_chunk *c, *prev;
+	heap_stats *st = h->stats;
+	h->stats = 0;
+	for( unsigned i = 0; i <= h->level; i++ ) __heap_free_large(h, h->levels + i);
+	for( c = h->chunk; c; c = prev ) { prev = c->prev; free(c); }
+	for( c = h->spare; c; c = prev ) { prev = c->prev; free(c); }
+	memset(h, 0, sizeof(*h));
+	h->stats = st;
+}
+
+#endif //_HEAP_H
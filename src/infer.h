@@ -0,0 +1,526 @@
+#ifndef _INFER_H
+#define _INFER_H
+#include <stdarg.h>
+#include "ir.h"
+
+/*
+// The stack check of polishc: an abstract interpretation of the IR which follows the
+// widths of what is on the stack through every block, by the stack effects listed in
+// src/common.h, and warns where an instruction takes something of another width than
+// it was pushed with. A block starts at each label; the state at a label is what the
+// code falling into it and every jump to it agree on, or nothing known at all.
+//
+// Instructions which only move bytes, Xswp, Xdrp, Xdup and Xund, may take several
+// whole elements, e.g. ldup of two I; arithmetic, comparisons, put and get take one
+// element of their width. A string is the C literals down to a C literal zero, or an
+// S pushed by a string instruction, kept with the most bytes it can have.
+//
+// Nothing is known of the stack after a call, a join or a recv, which may leave anything
+// on it, nor at the start of a task or a pfor routine. The body of a loop is run once;
+// if it does not leave the stack as it found it, nothing is known after it.
+*/
+#define INFER_MAX_WARNINGS 32
+#define INFER_LOOPS 16
+
+enum { INFER_STR = 5, INFER_BYTES = 6 };
+enum { INFER_NEXT, INFER_STOP, INFER_JUMP, INFER_COND };
+
+typedef struct {
+	unsigned char t;		/* T_CHAR..T_LONG, INFER_STR or INFER_BYTES */
+	unsigned char known;	/* val is the value of the number */
+	unsigned char label;	/* val is the label of an IR_ADDR */
+	unsigned long val;		/* for INFER_STR and INFER_BYTES the most bytes, 0 if unknown */
+} infer_elem;
+
+typedef struct {
+	infer_elem *e;
+	size_t n, cap;
+	size_t depth;			/* bytes of the elements of known size */
+	size_t unknown;			/* elements of unknown size */
+	int floor;				/* e starts at the bottom of the stack */
+	int reached;
+} infer_state;
+
+typedef struct {
+	ir_prog *p;
+	infer_state *states;	/* at the start of the program, then at each label */
+	size_t *at;				/* the IR index each block starts at */
+	size_t *work, work_len;
+	char *queued;
+	int warn;
+	unsigned long warnings;
+} infer_ctx;
+
+size_t __infer_size(const infer_elem *e) {
+	return e->t <= T_LONG ? (size_t) T_TO_SIZE(e->t) : e->val;
+}
+
+const char *__infer_desc(const unsigned t) {
+	static const char *descs[] = { "", "C", "R", "I", "L", "S", "bytes" };
+	return descs[t];
+}
+
+const char *__infer_name(const int op) {
+	if( op >= T_CHAR && op <= T_LONG )	return "literal";
+	if( op == '?' )						return "?";
+	if( op == '!' )						return "!";
+	return instr_names[-op];
+}
+
+void __infer_warn(infer_ctx *c, const ir_instr *in, const char *fmt, ...) {
+	va_list args;
+	if( !c->warn || c->warnings++ >= INFER_MAX_WARNINGS ) return;
+	fprintf(stderr, "polishc: line %u: %s ", in->line, __infer_name(in->op));
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+}
+
+void __infer_push(infer_state *s, const infer_elem e) {
+	if( s->n == s->cap ) {
+		s->cap = s->cap ? 2*s->cap : 16;
+		s->e = realloc(s->e, s->cap*sizeof(infer_elem));
+	}
+	s->e[s->n++] = e;
+	s->depth += __infer_size(&e);
+	s->unknown += !__infer_size(&e);
+}
+
+void __infer_drop(infer_state *s) {
+	s->n--;
+	s->depth -= __infer_size(s->e + s->n);
+	s->unknown -= !__infer_size(s->e + s->n);
+}
+
+/* Forgets everything on the stack. */
+void __infer_lose(infer_state *s) {
+	s->n = s->depth = s->unknown = 0;
+	s->floor = 0;
+}
+
+void __infer_copy(infer_state *to, const infer_state *from) {
+	infer_elem *e = to->e;
+	const size_t cap = to->cap;
+	*to = *from;
+	to->e = e;
+	to->cap = cap;
+	if( to->cap < from->n ) to->e = realloc(to->e, (to->cap = from->n)*sizeof(infer_elem));
+	memcpy(to->e, from->e, from->n*sizeof(infer_elem));
+}
+
+/* Joins from into to; returns 1 if that changed to. */
+int __infer_join(infer_state *to, const infer_state *from) {
+	int changed = 0;
+	if( !to->reached ) {
+		__infer_copy(to, from);
+		to->reached = 1;
+		return 1;
+	}
+	if( !to->floor && !to->n ) return 0;
+	if( to->n != from->n || to->floor != from->floor ) { __infer_lose(to); return 1; }
+	for( size_t i = 0; i < to->n; i++ ) {
+		infer_elem *a = to->e + i;
+		const infer_elem *b = from->e + i;
+		if( a->t != b->t || a->label != b->label ) { __infer_lose(to); return 1; }
+		if( a->t > T_LONG && a->val != b->val && a->val ) {
+			to->depth -= a->val;
+			to->unknown++;
+			a->val = 0;
+			changed = 1;
+		}
+		if( a->t <= T_LONG && a->known && (!b->known || a->val != b->val) ) {
+			a->known = a->label = 0;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+/* Pops a number of size bytes; warns and forgets the stack if the top is something
+else. Returns the number, of unknown value if it is not a literal. */
+infer_elem __infer_pop_num(infer_ctx *c, infer_state *s, const ir_instr *in, const unsigned size) {
+	infer_elem r = { __builtin_ctz(size) + 1, 0, 0, 0 };
+	if( !s->n ) {
+		if( s->floor ) {
+			__infer_warn(c, in, "takes %s from an empty stack", __infer_desc(r.t));
+			__infer_lose(s);
+		}
+		return r;
+	}
+	const infer_elem *top = s->e + s->n - 1;
+	if( top->t == r.t ) {
+		r = *top;
+		__infer_drop(s);
+		return r;
+	}
+	if( top->t != INFER_BYTES ) __infer_warn(c, in, "takes %s, found %s", __infer_desc(r.t), __infer_desc(top->t));
+	__infer_lose(s);
+	return r;
+}
+
+/* Pops size bytes of whole numbers into out, top first, for the instructions which
+only move bytes; returns how many, or -1 if the stack is forgotten. */
+int __infer_pop_span(infer_ctx *c, infer_state *s, const ir_instr *in, const unsigned size, infer_elem *out) {
+	unsigned got = 0;
+	int k = 0;
+	while( got < size ) {
+		if( !s->n ) {
+			if( s->floor ) __infer_warn(c, in, "takes %u bytes from a stack of %u", size, got);
+			__infer_lose(s);
+			return -1;
+		}
+		const infer_elem *top = s->e + s->n - 1;
+		if( top->t > T_LONG || got + __infer_size(top) > size ) {
+			if( top->t != INFER_BYTES ) __infer_warn(c, in, "splits %s", __infer_desc(top->t));
+			__infer_lose(s);
+			return -1;
+		}
+		got += __infer_size(top);
+		out[k++] = *top;
+		__infer_drop(s);
+	}
+	return k;
+}
+
+void __infer_push_span(infer_state *s, const infer_elem *span, int k) {
+	while( k-- ) __infer_push(s, span[k]);
+}
+
+/* Pops the size bytes mput takes, or forgets the stack if they are not whole elements. */
+void __infer_pop_bytes(infer_state *s, const unsigned long size) {
+	unsigned long got = 0;
+	while( got < size && s->n && __infer_size(s->e + s->n - 1) && got + __infer_size(s->e + s->n - 1) <= size ) {
+		got += __infer_size(s->e + s->n - 1);
+		__infer_drop(s);
+	}
+	if( got < size ) __infer_lose(s);
+}
+
+/* Pops a string: an S, or C literals down to a C literal zero, which may be the zero
+of an S below them. Returns the most bytes it can have with its zero, or 0 if that is
+unknown; forgets the stack if there is no string on top. */
+size_t __infer_pop_str(infer_ctx *c, infer_state *s, const ir_instr *in) {
+	for( size_t k = s->n; k--; ) {
+		const infer_elem *e = s->e + k;
+		size_t len;
+		if( e->t == T_CHAR && e->known && e->val ) continue;
+		if( e->t == T_CHAR && e->known )	len = s->n - k;
+		else if( e->t == INFER_STR )		len = e->val ? s->n - k - 1 + e->val : 0;
+		else {
+			if( e->t != T_CHAR && e->t != INFER_BYTES ) __infer_warn(c, in, "takes a string, found %s", __infer_desc(e->t));
+			__infer_lose(s);
+			return 0;
+		}
+		while( s->n > k ) __infer_drop(s);
+		return len;
+	}
+	if( s->floor ) __infer_warn(c, in, "takes a string from a stack without one");
+	__infer_lose(s);
+	return 0;
+}
+
+void __infer_push_str(infer_state *s, const size_t len, const unsigned t) {
+	__infer_push(s, (infer_elem) { t, 0, 0, len });
+}
+
+void __infer_edge(infer_ctx *c, const infer_state *s, const size_t label);
+
+/* The most bytes, with the zero, of what sfmtp makes of the format polishc compiled at
+offset, or 0 if that is unknown: %s and unary numbers may be of any length. */
+size_t __infer_fmt_len(const ir_prog *p, const unsigned long offset) {
+	size_t len = 1, field;
+	fmt_op op;
+	for( size_t at = offset; at + sizeof(op) <= p->fmt_len; at += sizeof(op) ) {
+		memcpy(&op, p->fmt + at, sizeof(op));
+		switch( op.tok ) {
+		  case FMT_END:														return len;
+		  case FMT_LIT:
+			len += op.width;
+			at += FMT_LIT_SIZE(op.width);
+			continue;
+		  case FMT_CHAR: case FMT_RED: case FMT_INT: case FMT_LONG:
+			if( op.base == 1 )												return 0;
+			field = 1 + fmt_num_digits(SIZE_TO_MASK(1 << (FMT_CHAR - op.tok)), op.base);
+			len += field > (size_t) op.width || op.width < 0 ? field : (size_t) op.width;
+			continue;
+		  default:															return 0;
+		}
+	}
+	return 0;
+}
+
+/* Runs the instruction in on s; for INFER_JUMP, *target is the label jumped to. */
+int __infer_step(infer_ctx *c, infer_state *s, const ir_instr *in, size_t *target) {
+	const int op = in->op;
+	const unsigned w = 1U << ((-op - 1) & 3), vw = 1U << ((T_CVADD - op) & 3);
+	infer_elem a, span[8];
+	size_t len, len2;
+	int k, m;
+	switch( op ) {
+	  case T_CHAR...T_LONG:
+		__infer_push(s, (infer_elem) { op, 1, 0, in->val });								break;
+	  case IR_ADDR:
+		__infer_push(s, (infer_elem) { T_LONG, 1, 1, in->val });							break;
+	  case T_LSWP...T_CSWP:
+		if( (k = __infer_pop_span(c, s, in, w, span)) < 0 )								break;
+		if( (m = __infer_pop_span(c, s, in, w, span + k)) < 0 )							break;
+		__infer_push_span(s, span, k);
+		__infer_push_span(s, span + k, m);													break;
+	  case T_LDRP...T_CDRP:
+		__infer_pop_span(c, s, in, w, span);												break;
+	  case T_LDUP...T_CDUP:
+		if( (k = __infer_pop_span(c, s, in, w, span)) < 0 )								break;
+		__infer_push_span(s, span, k);
+		__infer_push_span(s, span, k);														break;
+	  case T_LPUT...T_CPUT:
+		__infer_pop_num(c, s, in, w);
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_LGET...T_CGET:
+		__infer_pop_num(c, s, in, 8);
+		__infer_push(s, (infer_elem) { __builtin_ctz(w) + 1, 0, 0, 0 });					break;
+	  case T_LCMP...T_CCMP:
+		__infer_pop_num(c, s, in, w);
+		a = __infer_pop_num(c, s, in, w);
+		__infer_push(s, a);
+		__infer_push(s, (infer_elem) { T_CHAR, 0, 0, 0 });									break;
+	  case T_LDIV...T_CINC:
+		if( op <= T_CADD ) __infer_pop_num(c, s, in, w);
+		__infer_pop_num(c, s, in, w);
+		__infer_push(s, (infer_elem) { __builtin_ctz(w) + 1, 0, 0, 0 });					break;
+	  case '!':
+		__infer_pop_num(c, s, in, 1);
+		__infer_push(s, (infer_elem) { T_CHAR, 0, 0, 0 });									break;
+	  case '?':
+		__infer_pop_num(c, s, in, 1);														return INFER_COND;
+	  case T_JMP:
+		a = __infer_pop_num(c, s, in, 8);
+		if( a.label ) { *target = a.val;													return INFER_JUMP; }
+		return INFER_STOP;
+	  case T_CALL:
+		a = __infer_pop_num(c, s, in, 8);
+		if( a.label ) __infer_edge(c, s, a.val);
+		__infer_lose(s);																	break;
+	  case T_SPAWN:
+		a = __infer_pop_num(c, s, in, 8);
+		if( a.label ) __infer_edge(c, &(infer_state) {0}, a.val);
+		a = __infer_pop_num(c, s, in, 4);
+		if( a.known )	__infer_pop_bytes(s, a.val);
+		else			__infer_lose(s);
+		__infer_push(s, (infer_elem) { T_LONG, 0, 0, 0 });									break;
+	  case T_JOIN:
+		__infer_pop_num(c, s, in, 8);
+		__infer_lose(s);																	break;
+	  case T_PFOR:
+		a = __infer_pop_num(c, s, in, 8);
+		if( a.label ) __infer_edge(c, &(infer_state) {0}, a.val);
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_CHAN:
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 4);
+		__infer_push(s, (infer_elem) { T_LONG, 0, 0, 0 });									break;
+	  case T_SEND:
+		__infer_pop_num(c, s, in, 8);
+		a = __infer_pop_num(c, s, in, 4);
+		if( a.known )	__infer_pop_bytes(s, a.val);
+		else			__infer_lose(s);
+		break;
+	  case T_RECV:
+		__infer_pop_num(c, s, in, 8);
+		__infer_lose(s);																	break;
+	  case T_CLOSE:
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_END: case T_RET:																return INFER_STOP;
+	  case T_LOOP:
+		__infer_pop_num(c, s, in, 8);
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_NEXT: case T_INDEX:
+		__infer_push(s, (infer_elem) { T_LONG, 0, 0, 0 });									break;
+	  case T_OPN:
+		__infer_pop_num(c, s, in, 4);
+		__infer_push(s, (infer_elem) { T_LONG, 0, 0, 0 });									break;
+	  case T_CLS: case T_RLSE: case T_CLSF:
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_MARK: case T_IN: case T_OUT:
+		__infer_push(s, (infer_elem) { T_LONG, 0, 0, 0 });									break;
+	  case T_MCPY: case T_MCMP:
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 8);
+		__infer_pop_num(c, s, in, 8);
+		if( op == T_MCMP ) __infer_push(s, (infer_elem) { T_CHAR, 0, 0, 0 });
+		break;
+	  case T_MSET:
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 1);
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_MGET:
+		a = __infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 8);
+		__infer_push_str(s, a.known ? a.val : 0, INFER_BYTES);								break;
+	  case T_MPUT:
+		a = __infer_pop_num(c, s, in, 4);
+		if( a.known )	__infer_pop_bytes(s, a.val);
+		else			__infer_lose(s);
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_LVCMP...T_CVADD:
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 8);
+		__infer_pop_num(c, s, in, 8);														break;
+	  case T_LVMAX...T_CVSUM:
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 8);
+		__infer_push(s, (infer_elem) { __builtin_ctz(vw) + 1, 0, 0, 0 });					break;
+	  case T_OPNF:
+		__infer_pop_num(c, s, in, 1);
+		__infer_push_str(s, __infer_pop_str(c, s, in), INFER_STR);
+		__infer_push(s, (infer_elem) { T_LONG, 0, 0, 0 });									break;
+	  case T_SPUTF:
+		__infer_pop_num(c, s, in, 8);
+		__infer_pop_str(c, s, in);															break;
+	  case T_SGETF:
+		__infer_pop_num(c, s, in, 8);
+		__infer_push_str(s, 0, INFER_STR);													break;
+	  case T_SFMT:
+		__infer_pop_str(c, s, in);
+		__infer_push_str(s, 0, INFER_STR);													break;
+	  case T_SFMTP:
+		a = __infer_pop_num(c, s, in, 4);
+		__infer_push_str(s, a.known ? __infer_fmt_len(c->p, a.val) : 0, INFER_STR);		break;
+	  case T_SSCN: case T_SSCNP:
+		if( op == T_SSCN )	__infer_pop_str(c, s, in);
+		else				__infer_pop_num(c, s, in, 4);
+		__infer_pop_str(c, s, in);
+		__infer_push_str(s, 0, INFER_BYTES);
+		__infer_push(s, (infer_elem) { T_CHAR, 0, 0, 0 });									break;
+	  case T_SDRP:
+		__infer_pop_str(c, s, in);															break;
+	  case T_SSWP:
+		len = __infer_pop_str(c, s, in);
+		len2 = __infer_pop_str(c, s, in);
+		__infer_push_str(s, len, INFER_STR);
+		__infer_push_str(s, len2, INFER_STR);												break;
+	  case T_SREV: case T_SCAP: case T_SLOW:
+		__infer_push_str(s, __infer_pop_str(c, s, in), INFER_STR);							break;
+	  case T_SSUB:
+		__infer_pop_num(c, s, in, 4);
+		__infer_pop_num(c, s, in, 4);
+		__infer_push_str(s, __infer_pop_str(c, s, in), INFER_STR);							break;
+	  case T_SDUP:
+		len = __infer_pop_str(c, s, in);
+		__infer_push_str(s, len, INFER_STR);
+		__infer_push_str(s, len, INFER_STR);												break;
+	  case T_SCMP:
+		__infer_pop_str(c, s, in);
+		__infer_push_str(s, __infer_pop_str(c, s, in), INFER_STR);
+		__infer_push(s, (infer_elem) { T_CHAR, 0, 0, 0 });									break;
+	  case T_STOK:
+		__infer_pop_num(c, s, in, 1);
+		len = __infer_pop_str(c, s, in);
+		__infer_push_str(s, len, INFER_STR);
+		__infer_push_str(s, len, INFER_STR);												break;
+	  default:
+		__infer_lose(s);																	break;
+	}
+	return INFER_NEXT;
+}
+
+/* Joins s into the state at label; queues its block if that changed it. */
+void __infer_edge(infer_ctx *c, const infer_state *s, const size_t label) {
+	if( !__infer_join(c->states + label + 1, s) || c->queued[label + 1] ) return;
+	c->queued[label + 1] = 1;
+	c->work[c->work_len++] = label + 1;
+}
+
+/* Runs block b from the state at its start to where it ends, passing its state on to
+the labels it reaches. */
+void __infer_block(infer_ctx *c, const size_t b, infer_state *s, infer_state *t) {
+	const ir_prog *p = c->p;
+	infer_elem und[8];
+	struct { size_t n, depth, unknown; } loop_at[INFER_LOOPS];
+	int und_k = 0, act, loops = 0;
+	size_t target = 0;
+	__infer_copy(s, c->states + b);
+	for( size_t i = c->at[b]; i < p->len; i++ ) {
+		const ir_instr *in = p->code + i;
+		if( in->op == IR_LABEL ) {
+			/* The bytes an und holds go back after the first instruction past the label,
+			which a jump to the label does not do. */
+			if( und_k ) __infer_lose(s);
+			__infer_edge(c, s, in->val);
+			break;
+		}
+		if( in->op == T_NEXT && (!loops--
+			|| loop_at[loops].n != s->n || loop_at[loops].depth != s->depth || loop_at[loops].unknown != s->unknown) ) {
+			/* The body of the loop runs again on a stack other than the one it was checked on. */
+			__infer_lose(s);
+			loops = 0;
+		}
+		if( in->op <= T_CUND && in->op >= T_LUND ) {
+			und_k = __infer_pop_span(c, s, in, 1U << (-in->op - 1), und);
+			continue;
+		}
+		act = __infer_step(c, s, in, &target);
+		if( und_k > 0 )		__infer_push_span(s, und, und_k);
+		else if( und_k )	__infer_lose(s);
+		und_k = 0;
+		if( in->op == T_LOOP && loops < INFER_LOOPS ) loop_at[loops++] = (typeof(*loop_at)) { s->n, s->depth, s->unknown };
+		else if( in->op == T_LOOP ) loops = 0;
+		if( act == INFER_STOP ) break;
+		if( act == INFER_JUMP ) { __infer_edge(c, s, target); break; }
+		if( act != INFER_COND || i + 1 == p->len ) continue;
+		in = p->code + ++i;
+		switch( in->op ) {
+		  case T_END: break;
+		  case T_JMP:
+			__infer_copy(t, s);
+			if( __infer_step(c, t, in, &target) == INFER_JUMP ) __infer_edge(c, t, target);
+			break;
+		  case IR_LABEL: case '?': case T_LUND...T_CUND:
+			__infer_lose(s);
+			i--;
+			break;
+		  default:
+			__infer_copy(t, s);
+			__infer_step(c, t, in, &target);
+			__infer_join(s, t);
+		}
+	}
+}
+
+int ir_pass_infer(ir_prog *p) {
+	const size_t blocks = p->label_count + 1;
+	infer_ctx c = { p, calloc(blocks, sizeof(infer_state)), malloc(blocks*sizeof(size_t)),
+		malloc(blocks*sizeof(size_t)), 0, calloc(blocks, 1), 0, 0 };
+	infer_state s = {0}, t = {0};
+	c.at[0] = 0;
+	for( size_t i = 0; i < p->len; i++ ) if( p->code[i].op == IR_LABEL ) c.at[p->code[i].val + 1] = i + 1;
+	c.states[0].reached = c.states[0].floor = 1;
+	c.work[c.work_len++] = 0;
+	c.queued[0] = 1;
+	while( c.work_len ) {
+		const size_t b = c.work[--c.work_len];
+		c.queued[b] = 0;
+		__infer_block(&c, b, &s, &t);
+	}
+	/* The states are final; each block is run once more, in the order of the source,
+	to warn. */
+	c.warn = 1;
+	for( size_t i = 0; i <= p->len; i++ ) {
+		if( i && p->code[i - 1].op != IR_LABEL ) continue;
+		const size_t b = i ? p->code[i - 1].val + 1 : 0;
+		if( c.states[b].reached ) __infer_block(&c, b, &s, &t);
+	}
+	if( c.warnings > INFER_MAX_WARNINGS ) fprintf(stderr, "polishc: %lu more warnings\n", c.warnings - INFER_MAX_WARNINGS);
+	for( size_t i = 0; i < blocks; i++ ) free(c.states[i].e);
+	free(c.states);
+	free(c.at);
+	free(c.work);
+	free(c.queued);
+	free(s.e);
+	free(t.e);
+	return 0;
+}
+
+#endif //_INFER_H
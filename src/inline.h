@@ -0,0 +1,64 @@
+#ifndef _INLINE_H
+#define _INLINE_H
+#include "peephole.h"
+
+/*
+// The inlining pass of polishc -O. A call to a small leaf subroutine, one which runs
+// straight from its label to a ret without labels, jumps or calls, is replaced by a
+// copy of the subroutine's instructions up to the ret. The subroutine itself stays, as
+// other code may still jump or fall into it. A call right after a ? or an Xund is left,
+// as is every call of a program whose layout the peephole pass would leave alone.
+*/
+#define INLINE_MAX 16
+
+/* Returns the number of instructions of the subroutine starting at IR index start
+up to its ret, or -1 if it cannot be inlined. */
+long __inline_body(const ir_prog *p, const size_t start) {
+	for( size_t i = start; i < p->len && i - start <= INLINE_MAX; i++ ) {
+		switch( p->code[i].op ) {
+		  case T_RET:
+			if( i > start && (p->code[i - 1].op == '?' || (p->code[i - 1].op <= T_CUND && p->code[i - 1].op >= T_LUND)) ) return -1;
+			return i - start;
+		  case IR_LABEL: case IR_ADDR: case T_JMP: case T_CALL: case T_CPP: case T_END:
+			return -1;
+		}
+	}
+	return -1;
+}
+
+int ir_pass_inline(ir_prog *p) {
+	unsigned long calls = 0, inlined = 0;
+	long *body;
+	size_t *at, n = 0, cap = p->cap;
+	ir_instr *out;
+	if( !__peephole_layout_free(p) ) return 0;
+	at = malloc((p->label_count + 1)*sizeof(size_t));
+	body = malloc((p->label_count + 1)*sizeof(long));
+	for( size_t i = 0; i < p->len; i++ ) if( p->code[i].op == IR_LABEL ) at[p->code[i].val] = i + 1;
+	for( size_t l = 0; l < p->label_count; l++ ) body[l] = __inline_body(p, at[l]);
+	out = malloc(cap*sizeof(ir_instr));
+	for( size_t i = 0; i < p->len; i++ ) {
+		const ir_instr *in = p->code + i;
+		long len = -1;
+		if( in->op == IR_ADDR && i + 1 < p->len && in[1].op == T_CALL ) {
+			calls++;
+			if( !(i > 0 && (in[-1].op == '?' || (in[-1].op <= T_CUND && in[-1].op >= T_LUND))) ) len = body[in->val];
+		}
+		if( n + (len < 0 ? 1 : len) > cap ) out = realloc(out, (cap = 2*cap + len)*sizeof(ir_instr));
+		if( len < 0 ) { out[n++] = *in; continue; }
+		memcpy(out + n, p->code + at[in->val], len*sizeof(ir_instr));
+		n += len;
+		i++;
+		inlined++;
+	}
+	free(p->code);
+	p->code = out;
+	p->len = n;
+	p->cap = cap;
+	if( calls ) fprintf(stderr, "polishc -O: %lu of %lu calls inlined\n", inlined, calls);
+	free(at);
+	free(body);
+	return 0;
+}
+
+#endif //_INLINE_H
@@ -0,0 +1,394 @@
+/* Generated by src/gen-instr-hash.c from instr_names in src/common.h; do not edit. */
+#define INSTR_HASH_MUL 0x07E8810CE4F07611UL
+#define INSTR_HASH_SHIFT 54
+#define INSTR_HASH_MAXLEN 5
+
+const unsigned long instr_hash_keys[1024] = {
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x70616373, 0x62757376, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x627573766C, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x706D6372, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x7669646C, 0x0, 0x6D75737672,
+	0x0, 0x0, 0x0, 0x6C6C6163,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x636E69,
+	0x706D6373, 0x6464617672, 0x0, 0x0,
+	0x6365646C, 0x0, 0x6C756D76, 0x0,
+	0x706D63766C, 0x0, 0x74757072, 0x64646172,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x6C756D, 0x0, 0x0,
+	0x6674656773, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x707264,
+	0x646E756C, 0x0, 0x0, 0x0,
+	0x707773, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x74757073, 0x0,
+	0x0, 0x0, 0x0, 0x76636572,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x6E696D76,
+	0x0, 0x6E696D766C, 0x6C756D7672, 0x0,
+	0x736C63, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x727265,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x70777363, 0x0, 0x0, 0x0,
+	0x636E696C, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x706D6376, 0x6E69,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x74756F, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x64646176, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x6275737672, 0x747570, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x627573, 0x65736F6C63, 0x76696472,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x646461, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x707063, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x63656472, 0x0,
+	0x0, 0x0, 0x706D637672, 0x0,
+	0x6B6F7473, 0x0, 0x0, 0x0,
+	0x0, 0x66736C63, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x7072646C, 0x0, 0x0,
+	0x0, 0x646E7572, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x6E696D7672, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x6674757073, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x6B72616D, 0x636E6972, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x74656763, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x78616D7663, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x746567, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x7077736C, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x62757363, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x646E65, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x6E637373,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x70726472,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x7478656E, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x6C756D63, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x70726473,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x70756463, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x706D63, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x6E77617073, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x6E696F6A,
+	0x0, 0x706D6363, 0x6D757376, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x7465736D,
+	0x6D75737663, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x78616D76, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x776F6C73,
+	0x0, 0x0, 0x6464617663, 0x0,
+	0x0, 0x0, 0x70777372, 0x0,
+	0x0, 0x0, 0x0, 0x6E706F,
+	0x74757063, 0x64646163, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x70777373, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x7465676C,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x6C756D7663,
+	0x0, 0x0, 0x78616D766C, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x65736C72, 0x0, 0x7465676D, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x6275736C, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x636564, 0x0,
+	0x0, 0x746572, 0x0, 0x706D6A,
+	0x0, 0x0, 0x0, 0x6275737663,
+	0x0, 0x0, 0x0, 0x0,
+	0x666E706F, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x706F6F6C,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x6C756D6C, 0x0,
+	0x76696463, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x646E6573, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x7075646C, 0x63656463,
+	0x0, 0x0, 0x0, 0x0,
+	0x706D637663, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x726F6670, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x646E7563,
+	0x0, 0x707564, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x74656772, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x7970636D,
+	0x6E696D7663, 0x0, 0x706D636C, 0x78616D7672,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x6D7573766C, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x74656773, 0x0, 0x0, 0x636E6963,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x706D636D, 0x646461766C,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x7475706C, 0x6464616C, 0x0, 0x0,
+	0x62757372, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x7475706D, 0x0, 0x0, 0x62757373,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x646E75, 0x0,
+	0x6C756D766C, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x766964, 0x6C756D72,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x76657273, 0x0,
+	0x0, 0x0, 0x6E616863, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x7865646E69,
+	0x0, 0x0, 0x0, 0x0,
+	0x70756472, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x746D6673, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x0,
+	0x70726463, 0x0, 0x0, 0x0,
+	0x0, 0x0, 0x0, 0x70756473,
+	0x0, 0x0, 0x0, 0x0,
+};
+
+const signed char instr_hash_toks[1024] = {
+	   5,    5,    5,    5,    5,  -74,  -96,    5,
+	   5,    5,    5,    5,  -97,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	 -26,    5,    5,    5,    5,    5,    5,    5,
+	   5,  -52,    5, -107,    5,    5,    5, -118,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -31,
+	 -73,  -91,    5,    5,  -36,    5, -100,    5,
+	-105,    5,  -18,  -38,    5,    5,    5,    5,
+	   5,  -47,    5,    5,  -70,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -11,
+	  -4,    5,    5,    5,   -7,    5,    5,    5,
+	   5,    5,  -65,    5,    5,    5,    5, -127,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5, -112,    5, -113,  -99,    5,
+	 -59,    5,    5,    5,    5,    5,    5,  -75,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	  -5,    5,    5,    5,  -32,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5, -104,  -71,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -67,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -92,    5,    5,    5,    5,    5,
+	   5,  -95,  -19,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,  -43, -128,  -50,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -39,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,  -78,    5,    5,    5,
+	   5,    5,  -34,    5,    5,    5, -103,    5,
+	 -64,    5,    5,    5,    5,  -58,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,  -12,    5,    5,    5,   -2,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5, -111,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,  -66,    5,    5,    5,    5,    5,    5,
+	   5,  -83,  -30,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -21,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5, -114,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,  -23,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,   -8,    5,    5,    5,
+	   5,    5,    5,    5,    5,  -41,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,  -79,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -72,
+	   5,    5,    5,    5,    5,    5,    5,  -10,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5, -122,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,  -45,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -57,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,  -13,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,  -27,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5, -120,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5, -124,    5,  -25, -108,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -86,
+	-106,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5, -116,    5,    5,
+	   5,    5,    5,  -76,    5,    5,  -90,    5,
+	   5,    5,   -6,    5,    5,    5,    5,  -63,
+	 -17,  -37,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -53,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -24,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,  -98,    5,    5, -117,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,  -84,    5,  -88,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -44,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,  -35,    5,
+	   5, -119,    5,  -77,    5,    5,    5,  -94,
+	   5,    5,    5,    5,  -62,    5,    5,    5,
+	   5,    5,    5, -121,    5,    5,    5,    5,
+	   5,    5,  -48,    5,  -49,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5, -126,    5,    5,
+	   5,    5,    5,    5,    5,    5,  -16,  -33,
+	   5,    5,    5,    5, -102,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,  -80,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,   -1,    5,  -15,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,  -22,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,  -85,
+	-110,    5,  -28, -115,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5, -109,    5,    5,
+	   5,    5,    5,    5,  -69,    5,    5,  -29,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -87,  -93,    5,    5,    5,    5,
+	   5,    5,    5,    5,  -20,  -40,    5,    5,
+	 -42,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,  -89,    5,    5,  -55,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,   -3,    5,
+	-101,    5,    5,    5,    5,    5,  -51,  -46,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,  -54,    5,    5,    5, -125,    5,
+	   5,    5,    5,    5,    5,    5,    5, -123,
+	   5,    5,    5,    5,  -14,    5,    5,    5,
+	   5,    5,    5,    5,    5,    5,    5,    5,
+	   5,    5,    5,    5,  -68,    5,    5,    5,
+	   5,    5,    5,    5,   -9,    5,    5,    5,
+	   5,    5,    5,  -61,    5,    5,    5,    5,
+};
@@ -0,0 +1,137 @@
+#ifndef _IR_H
+#define _IR_H
+#include "pbc.h"
+
+/*
+// The intermediate representation polishc compiles a program into before anything
+// is written: a list of instructions, literals and label definitions, each with the
+// source line it came from. The passes of polishc run over the list in order, the
+// label pass turning label definitions into program pointers and the encoding pass
+// turning the list into bytecode, which is then written whole.
+//
+// T_CHAR..T_LONG	literal val
+// IR_ADDR			long literal of the program pointer of label val
+// IR_LABEL			definition of label val, takes no space in the program
+// anything else	the instruction op
+*/
+#define IR_ADDR T_JMP_LABEL
+#define IR_LABEL T_NEW_LABEL
+
+typedef struct {
+	int op;
+	unsigned line;
+	unsigned long val;
+} ir_instr;
+
+typedef struct {
+	ir_instr *code;
+	size_t len, cap;
+	size_t *label_pc;
+	size_t label_count;
+	t_rnum *out;
+	size_t out_len, out_cap;
+	pbc_line *lines;
+	size_t line_count, line_cap;
+	const char *fmt;
+	size_t fmt_len;
+	int debug_map;
+} ir_prog;
+
+typedef struct {
+	const char *name;
+	int (*run)(ir_prog*);
+	int enabled;
+} ir_pass;
+
+void ir_push(ir_prog *p, const int op, const unsigned long val, const unsigned line) {
+	if( p->len == p->cap ) {
+		p->cap = p->cap ? 2*p->cap : 1024;
+		p->code = realloc(p->code, p->cap*sizeof(ir_instr));
+	}
+	p->code[p->len++] = (ir_instr) { op, line, val };
+}
+
+int ir_push_num(ir_prog *p, const int t, const unsigned long val, const unsigned line) {
+	const unsigned size = T_TO_SIZE(t);
+	if( size < sizeof(t_lnum) && val > SIZE_TO_MASK(size) ) {
+		sprintf(err_extra, "%lu >= 2^%u", val, 8*size);			return ERR_NUMTOOLARGE;
+	}
+	ir_push(p, t, val, line);
+	return 0;
+}
+
+/* The size of an IR instruction in the program, in instruction words. */
+size_t ir_size(const ir_instr *i) {
+	if( i->op >= T_CHAR && i->op <= T_LONG )	return T_TO_SIZE(i->op);
+	if( i->op == IR_ADDR )						return T_TO_SIZE(T_LONG);
+	if( i->op == IR_LABEL )						return 0;
+	return 1;
+}
+
+/* Lays the program out to find the program pointer of every label, then makes
+every IR_ADDR the literal of its label's program pointer. */
+int ir_pass_labels(ir_prog *p) {
+	size_t pc = 0;
+	p->label_pc = realloc(p->label_pc, (p->label_count + 1)*sizeof(size_t));
+	for( size_t i = 0; i < p->len; i++ ) {
+		if( p->code[i].op == IR_LABEL ) p->label_pc[p->code[i].val] = pc;
+		pc += ir_size(p->code + i);
+	}
+	for( size_t i = 0; i < p->len; i++ ) {
+		if( p->code[i].op != IR_ADDR ) continue;
+		p->code[i].op = T_LONG;
+		p->code[i].val = p->label_pc[p->code[i].val];
+	}
+	return 0;
+}
+
+void __ir_map_line(ir_prog *p, const size_t pc, const unsigned line) {
+	if( p->line_count && p->lines[p->line_count - 1].line == line ) return;
+	if( p->line_count && p->lines[p->line_count - 1].pc == pc ) { p->lines[p->line_count - 1].line = line; return; }
+	if( p->line_count == p->line_cap ) {
+		p->line_cap = p->line_cap ? 2*p->line_cap : 64;
+		p->lines = realloc(p->lines, p->line_cap*sizeof(pbc_line));
+	}
+	p->lines[p->line_count++] = (pbc_line) { pc, line };
+}
+
+/* Encodes the program into out, and with debug_map the map of its lines. */
+int ir_pass_encode(ir_prog *p) {
+	size_t need = 0;
+	for( size_t i = 0; i < p->len; i++ ) need += ir_size(p->code + i);
+	if( need > p->out_cap ) p->out = realloc(p->out, (p->out_cap = need)*sizeof(t_rnum));
+	p->out_len = 0;
+	for( size_t i = 0; i < p->len; i++ ) {
+		const ir_instr *in = p->code + i;
+		if( in->op == IR_LABEL ) continue;
+		if( p->debug_map ) __ir_map_line(p, p->out_len, in->line);
+		if( in->op == IR_ADDR ) {
+			sprintf(err_extra, "label %lu", in->val);					return ERR_LABELUNDEF;
+		}
+		if( in->op < T_CHAR || in->op > T_LONG ) {
+			p->out[p->out_len++] = MAGIC_INSTR | (unsigned char) in->op;
+			continue;
+		}
+#ifdef DEBUG
+		printf("\tCMPL: pushing num of type %u, size %u.\n", in->op, T_TO_SIZE(in->op));
+#endif
+		t_lnum num = in->val;
+		const t_rnum magic = T_TO_MAGIC(in->op);
+		p->out[p->out_len++] = magic | (t_cnum) (num & 0xFF);
+		for( int k = 1; k < T_TO_SIZE(in->op); k++ ) {
+			num >>= BITS_PER_BYTE*BYTES_PER_NUM;
+			p->out[p->out_len++] = magic | MAGIC_CONT | (t_cnum) (num & 0xFF);
+		}
+	}
+	return 0;
+}
+
+void ir_free(ir_prog *p) {
+	free(p->code);
+	free(p->label_pc);
+	free(p->out);
+	free(p->lines);
+	memset(p, 0, sizeof(*p));
+}
+
+#endif //_IR_H
@@ -0,0 +1,189 @@
+#ifndef _JOBS_H
+#define _JOBS_H
+#include <pthread.h>
+#include <time.h>
+#include "vm.h"
+
+/*
+// polish --jobs N runs one program over many inputs on a pool of N threads. The
+// program is loaded once; each input runs in a VM context of its own, with in bound
+// to the input file. With an output suffix the output of each input goes to the
+// file named by the input and the suffix. Without one it goes to a buffer, which the
+// main thread writes to standard out in the order of the inputs as soon as every
+// input before it is done, so the merged output is that of running them one by one.
+//
+// With polish --slice S the contexts are green threads: up to JOB_CONTEXTS of them per
+// thread are live at once, and a thread runs each for a slice of about S instructions,
+// see slice_spent(), before it puts it at the back of the ready queue and takes the
+// next. New inputs are started before suspended ones are resumed, so that a short
+// script waits behind long ones for no more than a slice of each. Without a slice
+// each context runs to its end, one per thread at a time.
+*/
+#define JOB_CONTEXTS 16
+
+typedef struct {
+	const char *path;
+	char *buf;			/* the output, without a suffix */
+	size_t len;
+	char *msg;			/* the error, if the run failed */
+	double ms;			/* from the start of run_jobs() until it was done */
+	int done;
+} job;
+
+/* A live input: its VM, suspended or running, and its files. */
+typedef struct {
+	polish_vm *v;
+	job *j;
+	FILE *in, *out;
+	heap_stats stats;
+} job_ctx;
+
+typedef struct {
+	const polish_prog *prog;
+	job *jobs;
+	size_t count, next;
+	const char *suffix;
+	int str_track;
+	size_t heap_cap;
+	unsigned long slice;
+	size_t live, max_live;
+	job_ctx **ready;		/* a ring of the suspended contexts */
+	size_t ready_head, ready_len;
+	polish_vm **spare;		/* the VMs of ended contexts, to reuse */
+	size_t spare_len;
+	struct timespec start;
+	pthread_mutex_t lock;
+	pthread_cond_t done, wake;
+} job_pool;
+
+FILE *__job_out(job *j, const char *suffix) {
+	if( !suffix ) return open_memstream(&j->buf, &j->len);
+	char *path = malloc(strlen(j->path) + strlen(suffix) + 1);
+	FILE *f = fopen(strcat(strcpy(path, j->path), suffix), "w");
+	free(path);
+	return f;
+}
+
+/* Starts a context for j, or returns 0 with the error in j if its files won't open. */
+job_ctx *__job_start(job_pool *pool, job *j) {
+	FILE *in = fopen(j->path, "r"), *out = in ? __job_out(j, pool->suffix) : 0;
+	char msg[ERR_EXTRA_LEN + 64];
+	if( !in || !out ) {
+		if( !in )	snprintf(msg, sizeof(msg), "File %s not found.", j->path);
+		else		snprintf(msg, sizeof(msg), "Couldn't open the output of %s.", j->path);
+		if( in ) fclose(in);
+		j->msg = strdup(msg);
+		return 0;
+	}
+	job_ctx *x = calloc(1, sizeof(job_ctx));
+	pthread_mutex_lock(&pool->lock);
+	x->v = pool->spare_len ? pool->spare[--pool->spare_len] : 0;
+	pthread_mutex_unlock(&pool->lock);
+	if( x->v )	polish_reset(x->v);
+	else		x->v = polish_create(pool->prog);
+	x->j = j;
+	x->in = in;
+	x->out = out;
+	x->stats = (heap_stats) { .cap = pool->heap_cap };
+	x->v->heap->stats = pool->heap_cap ? &x->stats : 0;
+	polish_set_io(x->v, in, out);
+	polish_set_strtrack(x->v, pool->str_track);
+	polish_set_slice(x->v, pool->slice);
+	return x;
+}
+
+/* Ends the context, keeping its VM, and marks its input done; the caller holds the lock. */
+void __job_end(job_pool *pool, job_ctx *x, const int err) {
+	job *j = x->j;
+	struct timespec now;
+	if( x->v ) {
+		if( err ) j->msg = strdup(polish_error(x->v));
+		fclose(x->in);
+		fclose(x->out);
+		x->v->heap->stats = 0;
+		free(x->stats.sites);
+		pool->spare[pool->spare_len++] = x->v;
+	}
+	pool->live--;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	j->ms = (now.tv_sec - pool->start.tv_sec)*1e3 + (now.tv_nsec - pool->start.tv_nsec)/1e6;
+	j->done = 1;
+	pthread_cond_broadcast(&pool->done);
+}
+
+void *__job_worker(void *arg) {
+	job_pool *pool = arg;
+	job_ctx *x;
+	int err;
+	pthread_mutex_lock(&pool->lock);
+	for( ;; ) {
+		if( pool->next < pool->count && pool->live < pool->max_live ) {
+			job *j = pool->jobs + pool->next++;
+			pool->live++;
+			pthread_mutex_unlock(&pool->lock);
+			x = __job_start(pool, j);
+			pthread_mutex_lock(&pool->lock);
+			if( !x ) { __job_end(pool, &(job_ctx) { .j = j }, 0); continue; }
+		}
+		else if( pool->ready_len ) {
+			x = pool->ready[pool->ready_head];
+			pool->ready_head = (pool->ready_head + 1) % pool->max_live;
+			pool->ready_len--;
+		}
+		else if( pool->live ) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+			continue;
+		}
+		else break;
+		pthread_mutex_unlock(&pool->lock);
+		err = polish_run(x->v);
+		pthread_mutex_lock(&pool->lock);
+		if( err == POLISH_SUSPENDED )	pool->ready[(pool->ready_head + pool->ready_len++) % pool->max_live] = x;
+		else							{ __job_end(pool, x, err); free(x); }
+		pthread_cond_signal(&pool->wake);
+	}
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+/* Runs p over the count inputs at paths on threads threads, in slices of about slice
+instructions unless it is 0; returns the number of inputs whose run failed, whose
+errors go to standard error, as do the times the inputs were done at with times. */
+size_t run_jobs(const polish_prog *p, char **paths, const size_t count, unsigned threads, const char *suffix,
+		const int str_track, const size_t heap_cap, const unsigned long slice, const int times) {
+	job_pool pool = { .prog = p, .jobs = calloc(count, sizeof(job)), .count = count, .suffix = suffix,
+		.str_track = str_track, .heap_cap = heap_cap, .slice = slice };
+	size_t failed = 0;
+	if( threads > count ) threads = count;
+	pool.max_live = slice ? JOB_CONTEXTS*threads : threads;
+	pool.ready = malloc(pool.max_live*sizeof(job_ctx*));
+	pool.spare = malloc(pool.max_live*sizeof(polish_vm*));
+	pthread_mutex_init(&pool.lock, 0);
+	pthread_cond_init(&pool.done, 0);
+	pthread_cond_init(&pool.wake, 0);
+	clock_gettime(CLOCK_MONOTONIC, &pool.start);
+	pthread_t *workers = malloc(threads*sizeof(pthread_t));
+	for( size_t i = 0; i < count; i++ ) pool.jobs[i].path = paths[i];
+	for( unsigned t = 0; t < threads; t++ ) pthread_create(workers + t, 0, __job_worker, &pool);
+	for( size_t i = 0; i < count; i++ ) {
+		job *j = pool.jobs + i;
+		pthread_mutex_lock(&pool.lock);
+		while( !j->done ) pthread_cond_wait(&pool.done, &pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+		if( j->buf ) fwrite(j->buf, 1, j->len, stdout);
+		if( j->msg ) { fprintf(stderr, "%s: %s\n", j->path, j->msg); failed++; }
+		if( times ) fprintf(stderr, "%s: done at %.1f ms\n", j->path, j->ms);
+		free(j->buf);
+		free(j->msg);
+	}
+	for( unsigned t = 0; t < threads; t++ ) pthread_join(workers[t], 0);
+	for( size_t i = 0; i < pool.spare_len; i++ ) polish_destroy(pool.spare[i]);
+	free(workers);
+	free(pool.ready);
+	free(pool.spare);
+	free(pool.jobs);
+	return failed;
+}
+
+#endif //_JOBS_H
@@ -1,80 +1,93 @@
 #include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
+#include "instr-hash.h"
 
-int match_instr(char *iden, unsigned len) {
-	int i = 0, j = 0;
-  	switch( len ) {
-  	  case 2:
-  		if( !memcmp(iden, instr_names[-T_IN], 2*sizeof(char)) )			return T_IN;
-  		return T_IDEN;
-	  case 3:
-		if( !memcmp(iden, instr_names[-T_END], 3*sizeof(char)) )		return T_END;
-		if( !memcmp(iden, instr_names[-T_JMP], 3*sizeof(char)) )		return T_JMP;
-		if( !memcmp(iden, instr_names[-T_CPP], 3*sizeof(char)) )		return T_CPP;
-		if( !memcmp(iden, instr_names[-T_OUT], 3*sizeof(char)) )		return T_OUT;
-		if( !memcmp(iden, instr_names[-T_ERR], 3*sizeof(char)) )		return T_ERR;
-		if( !memcmp(iden, instr_names[-T_CLS], 3*sizeof(char)) )		return T_CLS;
-		if( !memcmp(iden, instr_names[-T_OPN], 3*sizeof(char)) )		return T_OPN;
-		i = T_UND; j = T_DIV;
-		for( ; i >= j; i -= 4 ) {
-		 	if( !memcmp(iden, instr_names[-i], 3*sizeof(char)) )		return i;
-		}
-		return T_IDEN;
-	  case 4:
-		if( !memcmp(iden, instr_names[-T_SREV], 4*sizeof(char)) )		return T_SREV;
-		if( !memcmp(iden, instr_names[-T_SSUB], 4*sizeof(char)) )		return T_SSUB;
-		if( !memcmp(iden, instr_names[-T_STOK], 4*sizeof(char)) )		return T_STOK;
-		if( !memcmp(iden, instr_names[-T_SFMT], 4*sizeof(char)) )		return T_SFMT;
-		if( !memcmp(iden, instr_names[-T_SSCN], 4*sizeof(char)) )		return T_SSCN;
-		if( !memcmp(iden, instr_names[-T_SCAP], 4*sizeof(char)) )		return T_SCAP;
-		if( !memcmp(iden, instr_names[-T_SLOW], 4*sizeof(char)) )		return T_SLOW;
-		if( !memcmp(iden, instr_names[-T_OPNF], 4*sizeof(char)) )		return T_OPNF;
-		if( !memcmp(iden, instr_names[-T_CLSF], 4*sizeof(char)) )		return T_CLSF;
-		switch( iden[0] ) {
-			case 'c': i = T_CUND; j = T_CDIV; break;
-			case 'r': i = T_RUND; j = T_RDIV; break;
-			case 'l': i = T_LUND; j = T_LDIV; break;
-			case 's': i = T_SSWP; j = T_SGET; break;
-			default: return T_IDEN;
-		}
-		for( ; i >= j; i -= 4 ) {
-			if( !memcmp(iden + 1, instr_names[-i] + 1, 3*sizeof(char)) )return i;
-	  	}
-	  	return T_IDEN;
-	  case 5:
-	  	if( !memcmp(iden, instr_names[-T_SPUTF], 5*sizeof(char)) )		return T_SPUTF;
-	  	if( !memcmp(iden, instr_names[-T_SGETF], 5*sizeof(char)) )		return T_SGETF;
-	  	return T_IDEN;
-	  default:
-		return T_IDEN;
-  	}
+#define LEX_CHUNK (1 << 16)
+
+/* Identifiers are packed into a word and looked up in the perfect hash generated
+from instr_names, which holds each name as a key with its token. */
+int match_instr(const char *iden, unsigned len) {
+	unsigned long w = 0;
+	if( len > INSTR_HASH_MAXLEN )									return T_IDEN;
+	while( len-- ) w = w << 8 | (unsigned char) iden[len];
+	const unsigned h = w * INSTR_HASH_MUL >> INSTR_HASH_SHIFT;
+	if( instr_hash_keys[h] != w )									return T_IDEN;
+	return instr_hash_toks[h];
 }
 
+/*
+// The lexer works over the whole source in memory, mapped if it is a regular file
+// and read in chunks otherwise, and steps through it by pointer. Identifiers and
+// labels are not copied: val_iden points at them in the buffer, val_iden_count long.
+*/
 typedef struct {
-	FILE *f;
+	const char *buf;
+	const char *c;
+	const char *end;
+	size_t mapped;
 	unsigned lineno;
 	unsigned colno;
+	unsigned tok_lineno;
 	unsigned long val_num;
 	unsigned val_iden_count;
-	char *val_iden;
+	const char *val_iden;
 	char curr_char;
 	char parsing_string;
 } lex;
 
 lex make_lex(FILE *f) {
-	char *iden = malloc(32*sizeof(char));
-	return (lex) {f, 0, 0, 0, 0, iden, fgetc(f), 0};
+	struct stat st;
+	char *buf = 0;
+	size_t size = 0, mapped = 0, cap = 0, n;
+	if( !fstat(fileno(f), &st) && S_ISREG(st.st_mode) && st.st_size > 0 ) {
+		buf = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if( buf == MAP_FAILED ) buf = 0;
+		else {
+			size = mapped = st.st_size;
+			madvise(buf, size, MADV_SEQUENTIAL);
+		}
+	}
+	if( !buf ) {
+		do {
+			if( size == cap ) buf = realloc(buf, cap = cap ? 2*cap : LEX_CHUNK);
+			size += n = fread(buf + size, 1, cap - size, f);
+		} while( n );
+	}
+	return (lex) {buf, buf, buf + size, mapped, 0, 0, 0, 0, 0, buf, size ? *buf : T_EOF, 0};
+}
+
+void free_lex(lex *l) {
+	if( l->mapped )	munmap((void*) l->buf, l->mapped);
+	else			free((void*) l->buf);
+	l->buf = l->c = l->end = 0;
 }
 
 char __advance(lex *l) {
-	int c = fgetc(l->f);
-	if( c == EOF )	l->curr_char = T_EOF;
-	else			l->curr_char = (char) c;
+	if( l->c + 1 >= l->end ) {
+		l->c = l->end;
+		l->curr_char = T_EOF;
+		return T_EOF;
+	}
+	l->curr_char = *++l->c;
 	if( l->curr_char == '\n' )	{ l->lineno++;		l->colno = 0; }
 	else						  l->colno++;
 	return l->curr_char;
 }
 
+/* Takes the run of identifier characters at the current position as val_iden. */
+void __scan_iden(lex *l, const int underscore) {
+	const char *p = l->c;
+	while( p < l->end && (isalphanum(*p) || (underscore && *p == '_')) ) p++;
+	l->val_iden = l->c;
+	l->val_iden_count = p - l->c;
+	if( p == l->c ) return;
+	l->colno += p - l->c - 1;
+	l->c = p - 1;
+	__advance(l);
+}
+
 int __append_digit(lex *l, unsigned int c, int flags) {
 	if( flags < T_NOT_LEXED_YET ) return flags;
 	unsigned base = (flags & F_BASEMASK) >> 8;
@@ -148,7 +161,7 @@ int next_tok(lex *l) {
 	char curr_char = l->curr_char;
 	l->val_num = 0;
 	l->val_iden_count = 0;
-	l->val_iden[l->val_iden_count] = 0;
+	l->tok_lineno = l->lineno;
 	if( l->parsing_string ) {
 		if( curr_char == '\\' ) {
 			curr_char = __advance(l);
@@ -170,6 +183,7 @@ int next_tok(lex *l) {
 	while( isspace(curr_char) ) {
 		curr_char = __advance(l);
 	}
+	l->tok_lineno = l->lineno;
 	switch( curr_char ) {
 	  case 0: return T_EOF;
 	  case '+': __advance(l); return T_ADD;
@@ -200,27 +214,33 @@ int next_tok(lex *l) {
 		__advance(l);
 		return T_CHAR;
 	  case 'a'...'z': case 'A'...'Z':
-		while( isalphanum(curr_char) ) {
-			l->val_iden[l->val_iden_count++] = curr_char;
-			curr_char = __advance(l);
-		}
+		__scan_iden(l, 0);
 		return match_instr(l->val_iden, l->val_iden_count);
 	  case ':':
-		curr_char = __advance(l);
-		while( isalphanum(curr_char) || curr_char == '_' ) {
-			l->val_iden[l->val_iden_count++] = curr_char;
-			curr_char = __advance(l);
-		}
+		__advance(l);
+		__scan_iden(l, 1);
 		if( l->val_iden_count == 0 ) return T_INV_LABEL;
 		return T_NEW_LABEL;
 	  case '@':
-		curr_char = __advance(l);
-		while( isalphanum(curr_char) || curr_char == '_' ) {
-			l->val_iden[l->val_iden_count++] = curr_char;
-			curr_char = __advance(l);
-		}
+		__advance(l);
+		__scan_iden(l, 1);
 		if( l->val_iden_count == 0 ) return T_CPP;
 		return T_JMP_LABEL;
+	  case '&':
+		__advance(l);
+		__scan_iden(l, 1);
+		if( l->val_iden_count == 0 ) return T_INV_LABEL;
+		return T_CALL_LABEL;
+	  case '^':
+		__advance(l);
+		__scan_iden(l, 1);
+		if( l->val_iden_count == 0 ) return T_INV_LABEL;
+		return T_SPAWN_LABEL;
+	  case '|':
+		__advance(l);
+		__scan_iden(l, 1);
+		if( l->val_iden_count == 0 ) return T_INV_LABEL;
+		return T_PFOR_LABEL;
 	  default:
 		__advance(l);
 		return curr_char;
@@ -0,0 +1 @@
+#include "vm.h"
@@ -0,0 +1,46 @@
+#ifndef _LIBPOLISH_H
+#define _LIBPOLISH_H
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+// libpolish, the Polish virtual machine as a library (make lib builds bin/libpolish.a
+// and bin/libpolish.so). A polish_prog is a loaded .pbc file; it is only read once
+// loaded, so one program may be run by any number of VMs at once, in any threads.
+// A polish_vm is one run of a program and holds everything the run changes: its
+// stacks, error message, heap and in and out handles. A VM is used by one thread at
+// a time; polish_reset() readies it to run the program again from the start.
+*/
+#define POLISH_API __attribute__((visibility("default")))
+
+typedef struct polish_prog polish_prog;
+typedef struct polish_vm polish_vm;
+
+/* Load a program from the size bytes at pbc, which are copied, or from a file; 0 on failure. */
+POLISH_API polish_prog *polish_load_mem(const void *pbc, const size_t size);
+POLISH_API polish_prog *polish_load_file(const char *path);
+/* Frees a program no VM runs any more. */
+POLISH_API void polish_prog_free(polish_prog *p);
+
+/* A VM running p with standard in and out as in and out. */
+POLISH_API polish_vm *polish_create(const polish_prog *p);
+POLISH_API void polish_set_io(polish_vm *v, FILE *in, FILE *out);
+/* Tracks where the strings on the stack begin, as polish --strtrack. */
+POLISH_API void polish_set_strtrack(polish_vm *v, const int on);
+/* Runs the program until end; returns 0, or a nonzero error described by polish_error().
+With a slice it returns POLISH_SUSPENDED once it has run about that many instructions,
+and the next polish_run() resumes where it stopped. */
+POLISH_API int polish_run(polish_vm *v);
+#define POLISH_SUSPENDED -1
+/* The instructions each polish_run() of v may take, counted at backward jumps and at
+reads and writes of files; 0, the default, is no limit. */
+POLISH_API void polish_set_slice(polish_vm *v, const unsigned long n);
+POLISH_API const char *polish_error(const polish_vm *v);
+/* The number of threads that run the tasks programs spawn, by default one per CPU; it
+only takes effect before the first spawn of the process. */
+POLISH_API void polish_set_threads(const unsigned n);
+/* Empties the stacks and frees the heap of v, keeping its program and handles. */
+POLISH_API void polish_reset(polish_vm *v);
+POLISH_API void polish_destroy(polish_vm *v);
+
+#endif //_LIBPOLISH_H
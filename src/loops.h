@@ -0,0 +1,103 @@
+#ifndef _LOOPS_H
+#define _LOOPS_H
+#include "infer.h"
+#include "peephole.h"
+
+/*
+// The counted loop pass of polishc -O. It turns the loop idiom
+//	[counter] :label [body] linc #L[limit] lcmp cinc ? @label
+// into
+//	[counter] #L[limit] loop [body] next
+// which keeps the counter in a loop register of the virtual machine, so that an
+// iteration costs the one dispatch of next rather than the eight of the idiom. next
+// leaves the counter on the stack when the loop ends, as the idiom does.
+//
+// This is only done where no other jump goes to the label and the body leaves the
+// counter alone: run through the stack check from a stack holding just the counter,
+// the body must leave that stack as it found it without taking anything below its
+// top, except for ldup of the counter, which becomes index. The body may not contain
+// labels, jumps, calls, spawns or ?, so loops are turned innermost first, nor sfmt or
+// sfmtp, which may read anything below the format.
+*/
+
+/* Returns 1 if the body code[from..to) leaves the counter alone, making each ldup of
+the counter an index if so. */
+int __loops_body(ir_prog *p, ir_instr *code, const size_t from, const size_t to) {
+	infer_ctx c = { .p = p };
+	infer_state s = {0};
+	infer_elem und[8];
+	size_t *dups = malloc((to - from + 1)*sizeof(size_t)), dup_count = 0, target;
+	int und_k = 0, ok = 1;
+	/* The counter is marked with a label of 2, which no pushed element has. */
+	__infer_push(&s, (infer_elem) { T_LONG, 0, 2, 0 });
+	for( size_t i = from; ok && i < to; i++ ) {
+		const ir_instr *in = code + i;
+		switch( in->op ) {
+		  case IR_LABEL: case T_JMP: case T_CALL: case T_SPAWN: case T_PFOR: case T_RET: case T_END: case T_CPP: case '?':
+		  /* These read their arguments below the format, which the stack check does not follow. */
+		  case T_SFMT: case T_SFMTP:
+			ok = 0;
+			continue;
+		  case T_LUND...T_CUND:
+			und_k = __infer_pop_span(&c, &s, in, 1U << (-in->op - 1), und);
+			ok = s.n && s.e[0].label == 2;
+			continue;
+		}
+		if( in->op == T_LDUP && s.n == 1 ) {
+			dups[dup_count++] = i;
+			__infer_push(&s, (infer_elem) { T_LONG, 0, 0, 0 });
+		}
+		else __infer_step(&c, &s, in, &target);
+		if( und_k > 0 )		__infer_push_span(&s, und, und_k);
+		else if( und_k )	__infer_lose(&s);
+		und_k = 0;
+		ok = s.n && s.e[0].label == 2;
+	}
+	ok = ok && s.n == 1 && !und_k;
+	if( ok ) for( size_t i = 0; i < dup_count; i++ ) code[dups[i]].op = T_INDEX;
+	free(dups);
+	free(s.e);
+	return ok;
+}
+
+int ir_pass_loops(ir_prog *p) {
+	static const int idiom[] = { T_LINC, T_LONG, T_LCMP, T_CINC, IR_ADDR, T_LUND, '?', T_JMP, T_LDRP };
+	const size_t len = sizeof(idiom)/sizeof(*idiom);
+	size_t *refs, *at, n = 0;
+	unsigned long loops = 0, turned = 0;
+	if( !__peephole_layout_free(p) ) return 0;
+	refs = calloc(p->label_count, sizeof(size_t));
+	at = malloc(p->label_count*sizeof(size_t));
+	memset(at, 0xFF, p->label_count*sizeof(size_t));
+	for( size_t i = 0; i < p->len; i++ ) if( p->code[i].op == IR_ADDR ) refs[p->code[i].val]++;
+	for( size_t i = 0; i < p->len; i++ ) {
+		ir_instr *code = p->code;
+		size_t j = 0;
+		code[n++] = code[i];
+		if( code[n - 1].op == IR_LABEL ) at[code[n - 1].val] = n - 1;
+		if( code[n - 1].op != T_LDRP || n < len + 1 ) continue;
+		ir_instr *w = code + n - len;
+		while( j < len && w[j].op == idiom[j] ) j++;
+		if( j < len ) continue;
+		const size_t l = w[4].val;
+		loops++;
+		if( refs[l] != 1 || at[l] >= n - len || code[at[l]].op != IR_LABEL || code[at[l]].val != l ) continue;
+		if( at[l] > 0 && (code[at[l] - 1].op == '?' || (code[at[l] - 1].op <= T_CUND && code[at[l] - 1].op >= T_LUND)) ) continue;
+		if( !__loops_body(p, code, at[l] + 1, n - len) ) continue;
+		/* The body moves up by one to make room for the limit and loop in place of the label. */
+		const ir_instr limit = { T_LONG, code[at[l]].line, w[1].val }, next = { T_NEXT, w[0].line, 0 };
+		memmove(code + at[l] + 2, code + at[l] + 1, (n - len - at[l] - 1)*sizeof(ir_instr));
+		code[at[l]] = limit;
+		code[at[l] + 1] = (ir_instr) { T_LOOP, limit.line, 0 };
+		n = n - len + 1;
+		code[n++] = next;
+		turned++;
+	}
+	p->len = n;
+	if( loops ) fprintf(stderr, "polishc -O: %lu of %lu loops counted in loop registers\n", turned, loops);
+	free(refs);
+	free(at);
+	return 0;
+}
+
+#endif //_LOOPS_H
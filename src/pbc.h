@@ -0,0 +1,60 @@
+#ifndef _PBC_H
+#define _PBC_H
+#include <stdio.h>
+#include <string.h>
+
+/*
+// A .pbc file holds the bytecode of a program, optionally followed by sections of
+// data for the virtual machine. Every section is its payload followed by a
+// trailer with the payload size, the section id and PBC_MAGIC, so the loader finds
+// them by walking back from the end of the file. The last two words of a trailer
+// are not valid instructions, so files without sections load as before.
+//
+// PBC_SEC_FMT			format strings compiled by polishc, see fmt_compile()
+// PBC_SEC_LINES		pbc_line entries by increasing pc, written by polishc -g
+*/
+#define PBC_MAGIC 0x48534C50 /* "PLSH" */
+
+enum {
+	PBC_SEC_FMT = 1,
+	PBC_SEC_LINES = 2,
+	PBC_SEC_MAX = 8,
+};
+
+typedef struct {
+	unsigned long size;
+	unsigned id;
+	unsigned magic;
+} pbc_trailer;
+
+/* The instructions from pc on were compiled from the source line line, counting from 1. */
+typedef struct {
+	unsigned pc;
+	unsigned line;
+} pbc_line;
+
+typedef struct {
+	const char *data;
+	size_t size;
+} pbc_section;
+
+void pbc_write_section(FILE *out_file, const unsigned id, const void *data, const size_t size) {
+	pbc_trailer t = { size, id, PBC_MAGIC };
+	fwrite(data, 1, size, out_file);
+	fwrite(&t, sizeof(t), 1, out_file);
+}
+
+/* Finds the sections at the end of the size bytes of the file at data and returns
+the size of the bytecode before them; sections[id] is left alone for missing ids. */
+size_t pbc_read_sections(const char *data, size_t size, pbc_section *sections) {
+	pbc_trailer t;
+	while( size >= sizeof(t) ) {
+		memcpy(&t, data + size - sizeof(t), sizeof(t));
+		if( t.magic != PBC_MAGIC || t.size > size - sizeof(t) ) break;
+		size -= sizeof(t) + t.size;
+		if( t.id < PBC_SEC_MAX ) sections[t.id] = (pbc_section) { data + size, t.size };
+	}
+	return size;
+}
+
+#endif //_PBC_H
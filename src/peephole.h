@@ -0,0 +1,180 @@
+#ifndef _PEEPHOLE_H
+#define _PEEPHOLE_H
+#include "ir.h"
+
+/*
+// The optimisation pass of polishc -O. Each rule matches a window of consecutive IR
+// instructions and replaces it with what its fold function writes, or with nothing.
+// Patterns are written with C sized instructions and literals; a sized rule also
+// matches the same instructions and literals for R, I and L.
+//
+// Windows are matched at the end of the program as it is rewritten, one instruction
+// at a time, so that the result of a rewrite takes part in the next one. A window
+// never spans a label, and never directly follows a ? or an Xund, which act on the
+// single instruction after them. Programs that take the program pointer with cpp
+// or jump or call anywhere but to a label depend on the layout of the code, and are left alone.
+//
+// ! is a logical not: ! ! maps any true value to 1, so only ! ! ! becomes !.
+*/
+
+typedef struct {
+	const char *name;
+	int pat[3];
+	unsigned len;
+	int sized;
+	/* Writes the replacement of the window w of size bytes wide instructions to out
+	and returns its length, or -1 to leave the window be. */
+	int (*fold)(const ir_instr *w, const unsigned size, ir_instr *out);
+	unsigned long hits;
+} peephole_rule;
+
+/* The instruction of a C sized pattern element for width k. */
+int __peephole_shift(const int op, const unsigned k) {
+	if( op >= T_CHAR && op <= T_LONG )	return op + k;
+	if( op <= T_CUND && op >= T_LDIV )	return op - k;
+	return op;
+}
+
+int __fold_arith(const ir_instr *w, const unsigned size, ir_instr *out) {
+	const t_lnum lhs = w[0].val, rhs = w[1].val;
+	t_lnum r;
+	switch( w[2].op + __builtin_ctz(size) ) {
+	  case T_CADD: r = rhs + lhs; break;
+	  case T_CSUB: r = rhs - lhs; break;
+	  case T_CMUL: r = rhs * lhs; break;
+	  case T_CDIV:
+		if( !lhs ) return -1;
+		r = rhs / lhs; break;
+	  default: return -1;
+	}
+	out[0] = (ir_instr) { w[0].op, w[0].line, r & SIZE_TO_MASK(size) };
+	return 1;
+}
+
+int __fold_cmp(const ir_instr *w, const unsigned size, ir_instr *out) {
+	(void) size;
+	out[0] = w[0];
+	out[1] = (ir_instr) { T_CHAR, w[0].line, w[1].val > w[0].val ? 1 : w[1].val < w[0].val ? 0xFF : 0 };
+	return 2;
+}
+
+int __fold_swp(const ir_instr *w, const unsigned size, ir_instr *out) {
+	(void) size;
+	out[0] = w[1];
+	out[1] = w[0];
+	out[0].line = w[0].line;
+	return 2;
+}
+
+int __fold_inc(const ir_instr *w, const unsigned size, ir_instr *out) {
+	out[0] = (ir_instr) { w[0].op, w[0].line, (w[0].val + 1) & SIZE_TO_MASK(size) };
+	return 1;
+}
+
+int __fold_dec(const ir_instr *w, const unsigned size, ir_instr *out) {
+	out[0] = (ir_instr) { w[0].op, w[0].line, (w[0].val - 1) & SIZE_TO_MASK(size) };
+	return 1;
+}
+
+int __fold_not(const ir_instr *w, const unsigned size, ir_instr *out) {
+	(void) size;
+	out[0] = (ir_instr) { T_CHAR, w[0].line, !w[0].val };
+	return 1;
+}
+
+int __fold_not3(const ir_instr *w, const unsigned size, ir_instr *out) {
+	(void) size;
+	out[0] = w[0];
+	return 1;
+}
+
+peephole_rule peephole_rules[] = {
+	{ "dup drp",		{ T_CDUP, T_CDRP },				2, 1, 0,				0 },
+	{ "swp swp",		{ T_CSWP, T_CSWP },				2, 1, 0,				0 },
+	{ "inc dec",		{ T_CINC, T_CDEC },				2, 1, 0,				0 },
+	{ "dec inc",		{ T_CDEC, T_CINC },				2, 1, 0,				0 },
+	{ "literal drp",	{ T_CHAR, T_CDRP },				2, 1, 0,				0 },
+	{ "! ! !",			{ '!', '!', '!' },				3, 0, __fold_not3,		0 },
+	{ "fold add",		{ T_CHAR, T_CHAR, T_CADD },		3, 1, __fold_arith,		0 },
+	{ "fold sub",		{ T_CHAR, T_CHAR, T_CSUB },		3, 1, __fold_arith,		0 },
+	{ "fold mul",		{ T_CHAR, T_CHAR, T_CMUL },		3, 1, __fold_arith,		0 },
+	{ "fold div",		{ T_CHAR, T_CHAR, T_CDIV },		3, 1, __fold_arith,		0 },
+	{ "fold cmp",		{ T_CHAR, T_CHAR, T_CCMP },		3, 1, __fold_cmp,		0 },
+	{ "fold swp",		{ T_CHAR, T_CHAR, T_CSWP },		3, 1, __fold_swp,		0 },
+	{ "fold inc",		{ T_CHAR, T_CINC },				2, 1, __fold_inc,		0 },
+	{ "fold dec",		{ T_CHAR, T_CDEC },				2, 1, __fold_dec,		0 },
+	{ "fold !",			{ T_CHAR, '!' },				2, 0, __fold_not,		0 },
+};
+#define PEEPHOLE_RULES (sizeof(peephole_rules)/sizeof(*peephole_rules))
+
+int __peephole_layout_free(const ir_prog *p) {
+	for( size_t i = 0; i < p->len; i++ ) {
+		if( p->code[i].op == T_CPP ) return 0;
+		if( p->code[i].op != T_JMP && p->code[i].op != T_CALL && p->code[i].op != T_SPAWN && p->code[i].op != T_PFOR ) continue;
+		if( i >= 1 && p->code[i - 1].op == IR_ADDR ) continue;
+		if( i >= 3 && p->code[i - 1].op == '?' && p->code[i - 2].op == T_LUND && p->code[i - 3].op == IR_ADDR ) continue;
+		return 0;
+	}
+	return 1;
+}
+
+/* The rules, with the width they are tried for, whose window ends in each instruction. */
+struct { unsigned char rule, k; } peephole_by_last[256][8];
+unsigned char peephole_by_last_count[256];
+
+void __peephole_index(void) {
+	memset(peephole_by_last_count, 0, sizeof(peephole_by_last_count));
+	for( unsigned r = 0; r < PEEPHOLE_RULES; r++ ) {
+		for( unsigned k = 0; k < (peephole_rules[r].sized ? 4U : 1U); k++ ) {
+			const unsigned char last = __peephole_shift(peephole_rules[r].pat[peephole_rules[r].len - 1], k);
+			peephole_by_last[last][peephole_by_last_count[last]].rule = r;
+			peephole_by_last[last][peephole_by_last_count[last]++].k = k;
+		}
+	}
+}
+
+/* Applies the first rule matching a window at the end of code[0..*n); returns 1 if one did. */
+int __peephole_step(ir_instr *code, size_t *n) {
+	ir_instr out[3];
+	const unsigned char last = code[*n - 1].op;
+	for( unsigned c = 0; c < peephole_by_last_count[last]; c++ ) {
+		peephole_rule *rule = peephole_rules + peephole_by_last[last][c].rule;
+		const unsigned k = peephole_by_last[last][c].k;
+		unsigned j = 0;
+		if( *n < rule->len ) continue;
+		ir_instr *w = code + *n - rule->len;
+		while( j < rule->len && w[j].op == __peephole_shift(rule->pat[j], k) ) j++;
+		if( j < rule->len ) continue;
+		if( w > code && (w[-1].op == '?' || (w[-1].op <= T_CUND && w[-1].op >= T_LUND)) ) continue;
+		int len = rule->fold ? rule->fold(w, 1 << k, out) : 0;
+		if( len < 0 ) continue;
+		memcpy(w, out, len*sizeof(ir_instr));
+		*n = *n - rule->len + len;
+		rule->hits += rule->len - len;
+		return 1;
+	}
+	return 0;
+}
+
+int ir_pass_peephole(ir_prog *p) {
+	size_t n = 0, before = 0;
+	for( size_t i = 0; i < p->len; i++ ) before += p->code[i].op != IR_LABEL;
+	if( !__peephole_layout_free(p) ) {
+		fprintf(stderr, "polishc -O: the program computes jump targets, not optimised\n");
+		return 0;
+	}
+	__peephole_index();
+	for( size_t i = 0; i < p->len; i++ ) {
+		p->code[n++] = p->code[i];
+		while( __peephole_step(p->code, &n) );
+	}
+	p->len = n;
+	size_t after = 0;
+	for( size_t i = 0; i < p->len; i++ ) after += p->code[i].op != IR_LABEL;
+	fprintf(stderr, "polishc -O: %lu of %lu instructions removed\n", before - after, before);
+	for( unsigned r = 0; r < PEEPHOLE_RULES; r++ )
+		if( peephole_rules[r].hits ) fprintf(stderr, "\t%-12s %8lu\n", peephole_rules[r].name, peephole_rules[r].hits);
+	return 0;
+}
+
+#endif //_PEEPHOLE_H
@@ -1,143 +1,239 @@
 #include "lex.h"
+#include "fmt-lex.h"
+#include "pbc.h"
+#include "ir.h"
+#include "peephole.h"
+#include "inline.h"
+#include "loops.h"
+#include "infer.h"
 
 #define PBC_EXTEN "pbc"
-#define DEBUG
-#define MAX_LABELS 32
 
-char* global_label_chars = 0;
-char** global_label_idens = 0;
-size_t* global_label_vals = 0;
+/* With -g, the map from program pointers to source lines is written to the output. */
+int debug_map = 0;
 
-int write_num(FILE *out_file, t_lnum num, const t_rnum magic) {
-	unsigned size = MAGIC_TO_SIZE(magic);
+/* Labels are numbered in the order they are first seen and found by name through an
+open addressing table of their numbers + 1; the names stay slices of the source.
+Jumps refer to labels by number in the IR, so a label may be defined after a jump. */
+typedef struct {
+	const char *name;
+	unsigned len;
+	int defined;
+} label;
+
+label *labels = 0;
+size_t label_count = 0, label_cap = 0;
+size_t *label_table = 0;
+size_t label_table_cap = 0;
+
+/* A string literal is held back until the next token shows whether it is the format
+of an sfmt or sscn, which is then compiled into the format section. */
+char *lit_chars = 0;
+size_t lit_len = 0, lit_cap = 0;
+unsigned lit_line = 0;
+char *fmt_section = 0;
+size_t fmt_section_len = 0;
+
+/* The passes run over the IR of the program in this order; -O enables inline, peephole and loops. */
+ir_pass passes[] = {
+	{ "inline",		ir_pass_inline,		0 },
+	{ "peephole",	ir_pass_peephole,	0 },
+	{ "loops",		ir_pass_loops,		0 },
+	{ "types",		ir_pass_infer,		1 },
+	{ "labels",	ir_pass_labels,	1 },
+	{ "encode",	ir_pass_encode,	1 },
+};
+
+void append_lit(const char c) {
+	if( lit_len + 1 >= lit_cap ) {
+		lit_cap = lit_cap ? 2*lit_cap : 64;
+		lit_chars = realloc(lit_chars, lit_cap);
+	}
+	lit_chars[lit_len++] = c;
+}
+
+void push_lit(ir_prog *p) {
+	ir_push(p, T_CHAR, 0, lit_line);
+	for( size_t i = 0; i < lit_len; i++ ) ir_push(p, T_CHAR, (t_cnum) lit_chars[i], lit_line);
+}
+
+/* Returns the offset of the held back literal compiled as a format for tok,
+or -1 if it has an invalid directive and is left to fail at runtime. */
+long compile_fmt(const int tok) {
 #ifdef DEBUG
-	printf("\tCMPL: pushing num of type %u, size %u.\n", MAGIC_TO_T(magic), size);
+	printf("Precompiling format of %s...\n", instr_names[-tok]);
 #endif
-	unsigned pushes_needed = size / BYTES_PER_NUM;
-	if (num >= BYTE_SIZE*size)	{
-		sprintf(err_extra, "%lu >= 2^%u", num, size);			return ERR_NUMTOOLARGE;
-	}
-	t_rnum data = magic | (t_cnum) (num & 0xFF);
-	fwrite(&data, 1, INSTR_SIZE, out_file);
-	num >>= BITS_PER_BYTE*BYTES_PER_NUM;
-	while (--pushes_needed) {
-		t_rnum data = magic | MAGIC_CONT | (t_cnum) (num & 0xFF);
-		fwrite(&data, 1, INSTR_SIZE, out_file);
-		num >>= BITS_PER_BYTE*BYTES_PER_NUM;
-	}
-	return 0;
+	fmt_section = realloc(fmt_section, fmt_section_len + 2*sizeof(fmt_op)*(lit_len + 1));
+	append_lit(0);
+	size_t size = fmt_compile(lit_chars, --lit_len, tok == T_SSCN, fmt_section + fmt_section_len);
+	if( size == 0 ) return -1;
+	fmt_section_len += size;
+	return fmt_section_len - size;
 }
 
-int write_instr(FILE* out_file, const t_instr instr) {
-	t_rnum bytes = MAGIC_INSTR | (unsigned char) instr;
-	fwrite(&bytes, 1, INSTR_SIZE, out_file);
-	return 0;
+size_t __label_hash(const char *name, const unsigned len) {
+	size_t h = 0xCBF29CE484222325UL;
+	for( unsigned i = 0; i < len; i++ ) h = (h ^ (unsigned char) name[i]) * 0x100000001B3UL;
+	return h;
 }
 
-int find_label(const char *iden, const size_t iden_len) {
-	size_t i = 0;
-	while( i < MAX_LABELS - 1 ) {
-		if( *global_label_idens[i] == 0 ) return i;
-		if( (size_t) (global_label_idens[i+1] - global_label_idens[i]) != iden_len ) { i++; continue; }
-		if( memcmp(global_label_idens[i], iden, iden_len) == 0 ) return i;
-	}
-	for( size_t j = 0; j < (size_t) (global_label_idens[0] + MAX_LABELS*16 - global_label_idens[i]); j++ ) {
-		if( global_label_idens[i][j] == 0 && j == iden_len) return i;
-		if( global_label_idens[i][j] != iden[j] ) return MAX_LABELS;
+size_t __add_label(const char *name, const unsigned len, const int defined) {
+	if( label_count == label_cap ) {
+		label_cap = label_cap ? 2*label_cap : 64;
+		labels = realloc(labels, label_cap*sizeof(label));
 	}
-	return MAX_LABELS;
+	labels[label_count] = (label) { name, len, defined };
+	return label_count++;
 }
 
-int new_label(const char *iden, const size_t iden_len, const size_t new_idx, const size_t prog_p) {
-	size_t len_avail = global_label_idens[0] + 16*MAX_LABELS - global_label_idens[new_idx];
-	if( iden_len > len_avail ) {
-		sprintf(err_extra, "%*.s, %lu avail.", (int) iden_len, iden, len_avail); //TODO
-		return ERR_LABELCHAROVERFLOW;
+/* Returns the number of the label, adding it undefined if it is new. */
+size_t find_label(const char *name, const unsigned len) {
+	size_t i, mask;
+	if( 2*(label_count + 1) > label_table_cap ) {
+		free(label_table);
+		label_table_cap = label_table_cap ? 2*label_table_cap : 64;
+		label_table = calloc(label_table_cap, sizeof(size_t));
+		mask = label_table_cap - 1;
+		for( size_t j = 0; j < label_count; j++ ) {
+			for( i = __label_hash(labels[j].name, labels[j].len) & mask; label_table[i]; i = (i + 1) & mask );
+			label_table[i] = j + 1;
+		}
 	}
-	memcpy(global_label_idens[new_idx], iden, iden_len);
-	global_label_idens[new_idx + 1] = global_label_idens[new_idx] + iden_len;
-	global_label_vals[new_idx] = prog_p;
-	return 0;
+	mask = label_table_cap - 1;
+	for( i = __label_hash(name, len) & mask; label_table[i]; i = (i + 1) & mask ) {
+		label *lb = labels + label_table[i] - 1;
+		if( lb->len == len && !memcmp(lb->name, name, len) ) return label_table[i] - 1;
+	}
+	label_table[i] = __add_label(name, len, 0) + 1;
+	return label_count - 1;
 }
 
-int compile(FILE *in_file, FILE *out_file) {
-	global_label_idens = malloc(MAX_LABELS);
-	global_label_chars = calloc(MAX_LABELS*16, 1);
-	global_label_vals = malloc(MAX_LABELS*sizeof(size_t));
-	global_label_idens[0] = global_label_chars;
+/* Returns the number of a new label without a name, for code polishc generates. */
+size_t anon_label(void) {
+	return __add_label(0, 0, 1);
+}
 
-	lex l = make_lex(in_file);
-	int tok, err, cond = 0;
-	size_t label_idx = 0, prog_p = 0;
-	while (tok = next_tok(&l), tok) {
+/* Builds the IR of the program from the tokens of l. */
+int parse(lex *l, ir_prog *p) {
+	int tok, op, err, cond = 0, lit_open = 0;
+	long fmt_offset;
+	size_t label_idx = 0;
+	unsigned line;
+	while (tok = next_tok(l), tok) {
+		line = l->tok_lineno + 1;
+		if( lit_open && !(tok == T_CHAR && l->parsing_string && l->val_num) ) {
+			lit_open = 0;
+			if( (tok == T_SFMT || tok == T_SSCN) && (fmt_offset = compile_fmt(tok)) >= 0 ) {
+				ir_push(p, T_INT, fmt_offset, lit_line);
+				ir_push(p, tok == T_SFMT ? T_SFMTP : T_SSCNP, 0, line);
+				continue;
+			}
+			push_lit(p);
+		}
 		switch (tok) {
-		  case T_EOF: return 0;
 		  case T_IDEN:
-		  	printf(err_strs[ERR_INVINSTR - 1], l.val_iden); return ERR_INVINSTR;
-		  	break;
+			snprintf(err_extra, ERR_EXTRA_LEN, "%.*s", (int) l->val_iden_count, l->val_iden); return ERR_INVINSTR;
 		  case T_CHAR...T_LONG:
-			if( cond ) {
-				if( (err = write_instr(out_file, '?')) ) return err;
-				prog_p++; cond = 0;
+			if( lit_open ) { append_lit(l->val_num); break; }
+			if( tok == T_CHAR && l->parsing_string && l->val_num == 0 && !cond ) {
+				lit_open = 1; lit_len = 0; lit_line = line;
+				break;
 			}
-			prog_p += T_TO_SIZE(tok);
-			if( (err = write_num(out_file, l.val_num, T_TO_MAGIC(tok))) ) return err;
+			if( cond ) { ir_push(p, '?', 0, line); cond = 0; }
+			if( (err = ir_push_num(p, tok, l->val_num, line)) ) return err;
 			break;
 		  case (-600)...T_NOT_LEXED_YET:
 			printf("LEX ERR: %s\n", err_strs[T_NOT_LEXED_YET - err]);
 			return ERR_LEX;
 		  case T_NEW_LABEL:
 #ifdef DEBUG
-			printf("Trying to add a new label at %lu...\n", prog_p);
+			printf("Trying to add a new label at line %u...\n", line);
 #endif
-			if( (label_idx = find_label(l.val_iden, l.val_iden_count)) != MAX_LABELS) {
-				if( *global_label_idens[label_idx] ) {
-					sprintf(err_extra, "%*.s, def: %lu", (int) l.val_iden_count, l.val_iden, prog_p);
-					return ERR_LABELREDEF;
-				}
+			label_idx = find_label(l->val_iden, l->val_iden_count);
+			if( labels[label_idx].defined ) {
+				snprintf(err_extra, ERR_EXTRA_LEN, "%.*s, line %u", (int) l->val_iden_count, l->val_iden, line);
+				return ERR_LABELREDEF;
 			}
-#ifdef DEBUG
-			printf("...Label not found, good.\n");
-#endif
-			if( (err = new_label(l.val_iden, l.val_iden_count, label_idx, prog_p)) ) return err;
+			labels[label_idx].defined = 1;
+			ir_push(p, IR_LABEL, label_idx, line);
 			break;
 		  case T_JMP_LABEL:
-#ifdef DEBUG
-			printf("Trying to add jmp to label...\n");
-#endif
-			if( (label_idx = find_label(l.val_iden, l.val_iden_count)) == MAX_LABELS) return ERR_LABELUNDEF;
-			if( *global_label_idens[label_idx] == 0 ) return ERR_LABELUNDEF;
-			if( (err = write_num(out_file, global_label_vals[label_idx], MAGIC_LONG)) ) return err;
-			prog_p += 8;
+			label_idx = find_label(l->val_iden, l->val_iden_count);
+			ir_push(p, IR_ADDR, label_idx, line);
 			if( cond ) {
-				if( (err = write_instr(out_file, T_LUND)) ) return err;
-				if( (err = write_instr(out_file, '?')) ) return err;
-				if( (err = write_instr(out_file, T_JMP)) ) return err;
-				if( (err = write_instr(out_file, T_LDRP)) ) return err;
-				prog_p += 4; cond = 0;
+				ir_push(p, T_LUND, 0, line);
+				ir_push(p, '?', 0, line);
+				ir_push(p, T_JMP, 0, line);
+				ir_push(p, T_LDRP, 0, line);
+				cond = 0;
 			}
-			else {
-				if( (err = write_instr(out_file, T_JMP)) ) return err;
-				prog_p++;
+			else ir_push(p, T_JMP, 0, line);
+			break;
+		  case T_CALL_LABEL: case T_SPAWN_LABEL: case T_PFOR_LABEL:
+			label_idx = find_label(l->val_iden, l->val_iden_count);
+			op = tok == T_CALL_LABEL ? T_CALL : tok == T_SPAWN_LABEL ? T_SPAWN : T_PFOR;
+			if( cond ) {
+				/* The call returns past it, so a conditional call, spawn or pfor jumps over it instead. */
+				const size_t skip = anon_label();
+				ir_push(p, '!', 0, line);
+				ir_push(p, IR_ADDR, skip, line);
+				ir_push(p, T_LUND, 0, line);
+				ir_push(p, '?', 0, line);
+				ir_push(p, T_JMP, 0, line);
+				ir_push(p, T_LDRP, 0, line);
+				ir_push(p, IR_ADDR, label_idx, line);
+				ir_push(p, op, 0, line);
+				ir_push(p, IR_LABEL, skip, line);
+				cond = 0;
+				break;
 			}
+			ir_push(p, IR_ADDR, label_idx, line);
+			ir_push(p, op, 0, line);
 			break;
 		  case '?':
 			cond = 1;
 			break;
 		  default:
-			if( cond ) {
-				if( (err = write_instr(out_file, '?')) ) return err;
-				prog_p++;
-				cond = 0;
-			}
-			if( (err = write_instr(out_file, tok)) ) { printf("%s%s%s\n", err_notify, err_strs[err - 1], err_extra); return err; }
-			prog_p++;
+			if( cond ) { ir_push(p, '?', 0, line); cond = 0; }
+			ir_push(p, tok, 0, line);
 			break;
 		}
 	}
+	if( lit_open ) push_lit(p);
+	for( size_t i = 0; i < label_count; i++ ) {
+		if( labels[i].defined ) continue;
+		snprintf(err_extra, ERR_EXTRA_LEN, "%.*s", (int) labels[i].len, labels[i].name);	return ERR_LABELUNDEF;
+	}
+	p->label_count = label_count;
 	return 0;
 }
 
+/* Parses the program, runs the passes over it and writes the bytecode with its
+sections in one go. */
+int compile(FILE *in_file, FILE *out_file) {
+	lex l = make_lex(in_file);
+	ir_prog p = {0};
+	p.debug_map = debug_map;
+	int err = parse(&l, &p);
+	p.fmt = fmt_section;
+	p.fmt_len = fmt_section_len;
+	for( size_t i = 0; !err && i < sizeof(passes)/sizeof(*passes); i++ ) {
+		if( !passes[i].enabled ) continue;
+#ifdef DEBUG
+		printf("Running pass %s over %lu instructions...\n", passes[i].name, p.len);
+#endif
+		err = passes[i].run(&p);
+	}
+	if( !err ) {
+		fwrite(p.out, sizeof(t_rnum), p.out_len, out_file);
+		if( fmt_section_len ) pbc_write_section(out_file, PBC_SEC_FMT, fmt_section, fmt_section_len);
+		if( p.line_count ) pbc_write_section(out_file, PBC_SEC_LINES, p.lines, p.line_count*sizeof(pbc_line));
+	}
+	ir_free(&p);
+	free_lex(&l);
+	return err;
+}
+
 char *extension_to_pbc(char *file_path) {
 	char *c = file_path;
 	char *last_dot = c;
@@ -154,6 +250,13 @@ char *extension_to_pbc(char *file_path) {
 int main(int argc, char *argv[]) {
 	FILE *input_file = 0;
 	FILE *output_file = 0;
+	int argn = 1;
+	for( int i = 1; i < argc; i++ ) {
+		if( strcmp(argv[i], "-g") == 0 ) debug_map = 1;
+		else if( strcmp(argv[i], "-O") == 0 ) passes[0].enabled = passes[1].enabled = passes[2].enabled = 1;
+		else argv[argn++] = argv[i];
+	}
+	argc = argn;
 	switch (argc) {
 	  case 2:
 	  	if (strcmp(argv[1], "-") == 0) {
@@ -178,7 +281,7 @@ int main(int argc, char *argv[]) {
 	if (output_file == 0) { printf("Couldn't open file %s.\n", argv[2]); return 1; }
 	int err = compile(input_file, output_file);
 	if (err) {
-		printf("%s%s%s\n", err_notify, err_strs[err], err_extra);
+		printf("%s%s%s\n", err_notify, err_strs[err - 1], err_extra);
 		printf("Program read error.\nExiting...\n");
 		return 1;
 	}
@@ -0,0 +1,174 @@
+#ifndef _POOL_H
+#define _POOL_H
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+// The work-stealing pool behind spawn and join. Each worker thread owns a deque of
+// tasks: it pushes the tasks it spawns at the bottom and pops them from there, newest
+// first, while idle workers steal from the top of the other deques, oldest first,
+// which in divide and conquer are the largest pieces of work. Threads outside the
+// pool, such as the one running the main program, share deque 0 and steal like the
+// workers. A thread waiting for a task runs other tasks until it is done, so join
+// never leaves a thread idle that has work it could do, and sleeps with the idle
+// workers while there is none, to be woken by the end of the task or by new work.
+//
+// The pool starts on the first spawn with sched_threads - 1 workers, as the thread
+// that spawns runs tasks too, and lives until the process exits. sched_threads is one
+// per CPU unless set before. A thread which blocks outside join, on a channel, may add
+// a worker; see sched_block().
+*/
+#define SCHED_MAX_EXTRA 256
+
+enum { SCHED_RUNNING, SCHED_DONE, SCHED_JOINED };
+
+typedef struct sched_task {
+	void (*run)(struct sched_task *t);
+	int done;				/* SCHED_JOINED while it runs with its joiner asleep */
+} sched_task;
+
+/* items[top..bottom), with both counting up and taken modulo cap. */
+typedef struct {
+	pthread_mutex_t lock;
+	sched_task **items;
+	size_t top, bottom, cap;
+} sched_deque;
+
+typedef struct {
+	unsigned workers;
+	sched_deque *deques;
+	unsigned long queued;
+	unsigned idle;
+	unsigned extra;			/* workers started by sched_block() */
+	pthread_mutex_t idle_lock;
+	pthread_cond_t wake;
+} sched_pool;
+
+unsigned sched_threads = 0;
+sched_pool sched_global;
+pthread_once_t sched_once = PTHREAD_ONCE_INIT;
+_Thread_local unsigned sched_self = 0;
+
+void __sched_push(sched_deque *d, sched_task *t) {
+	pthread_mutex_lock(&d->lock);
+	if( d->bottom - d->top == d->cap ) {
+		const size_t cap = d->cap ? 2*d->cap : 64;
+		sched_task **items = malloc(cap*sizeof(sched_task*));
+		for( size_t i = d->top; i < d->bottom; i++ ) items[i % cap] = d->items[i % d->cap];
+		free(d->items);
+		d->items = items;
+		d->cap = cap;
+	}
+	d->items[d->bottom++ % d->cap] = t;
+	pthread_mutex_unlock(&d->lock);
+}
+
+sched_task *__sched_pop(sched_deque *d, const int bottom) {
+	sched_task *t = 0;
+	pthread_mutex_lock(&d->lock);
+	if( d->bottom > d->top ) t = bottom ? d->items[--d->bottom % d->cap] : d->items[d->top++ % d->cap];
+	pthread_mutex_unlock(&d->lock);
+	return t;
+}
+
+/* Takes a task from the deque of this thread, or else steals one; 0 if there is none. */
+sched_task *sched_take(void) {
+	sched_pool *p = &sched_global;
+	sched_task *t = __sched_pop(p->deques + sched_self, 1);
+	for( unsigned k = 1; !t && k <= p->workers; k++ ) t = __sched_pop(p->deques + (sched_self + k) % (p->workers + 1), 0);
+	if( t ) __atomic_fetch_sub(&p->queued, 1, __ATOMIC_SEQ_CST);
+	return t;
+}
+
+void *__sched_worker(void *arg) {
+	sched_pool *p = &sched_global;
+	sched_self = (unsigned) (size_t) arg;
+	for( ;; ) {
+		sched_task *t = sched_take();
+		if( t ) { t->run(t); continue; }
+		pthread_mutex_lock(&p->idle_lock);
+		__atomic_fetch_add(&p->idle, 1, __ATOMIC_SEQ_CST);
+		while( !__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) ) pthread_cond_wait(&p->wake, &p->idle_lock);
+		__atomic_fetch_sub(&p->idle, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&p->idle_lock);
+	}
+	return 0;
+}
+
+void __sched_start(void) {
+	sched_pool *p = &sched_global;
+	pthread_t thread;
+	if( !sched_threads ) sched_threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	p->workers = sched_threads > 1 ? sched_threads - 1 : 0;
+	p->deques = calloc(p->workers + 1, sizeof(sched_deque));
+	for( unsigned i = 0; i <= p->workers; i++ ) pthread_mutex_init(&p->deques[i].lock, 0);
+	pthread_mutex_init(&p->idle_lock, 0);
+	pthread_cond_init(&p->wake, 0);
+	for( unsigned i = 1; i <= p->workers; i++ ) {
+		pthread_create(&thread, 0, __sched_worker, (void*) (size_t) i);
+		pthread_detach(thread);
+	}
+}
+
+/* The number of threads that run tasks with the one calling, starting the pool if need be. */
+unsigned sched_size(void) {
+	pthread_once(&sched_once, __sched_start);
+	return sched_global.workers + 1;
+}
+
+void sched_spawn(sched_task *t) {
+	sched_pool *p = &sched_global;
+	pthread_once(&sched_once, __sched_start);
+	t->done = SCHED_RUNNING;
+	__sched_push(p->deques + sched_self, t);
+	__atomic_fetch_add(&p->queued, 1, __ATOMIC_SEQ_CST);
+	if( !__atomic_load_n(&p->idle, __ATOMIC_SEQ_CST) ) return;
+	pthread_mutex_lock(&p->idle_lock);
+	pthread_cond_signal(&p->wake);
+	pthread_mutex_unlock(&p->idle_lock);
+}
+
+/* Marks t done, waking its joiner if it sleeps; its run function calls this last, as
+the joiner may free t as soon as it is marked. */
+void sched_done(sched_task *t) {
+	sched_pool *p = &sched_global;
+	if( __atomic_exchange_n(&t->done, SCHED_DONE, __ATOMIC_ACQ_REL) != SCHED_JOINED ) return;
+	pthread_mutex_lock(&p->idle_lock);
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->idle_lock);
+}
+
+/* Called by a thread about to block on something other than a task, e.g. a channel:
+starts another worker if tasks are waiting and no worker is idle to take them, so
+that a blocked thread never holds up the tasks it may be waiting for. Such workers
+share deque 0 and stay in the pool. */
+void sched_block(void) {
+	sched_pool *p = &sched_global;
+	pthread_t thread;
+	pthread_once(&sched_once, __sched_start);
+	if( !__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) || __atomic_load_n(&p->idle, __ATOMIC_SEQ_CST) ) return;
+	if( __atomic_fetch_add(&p->extra, 1, __ATOMIC_SEQ_CST) >= SCHED_MAX_EXTRA ) return;
+	pthread_create(&thread, 0, __sched_worker, 0);
+	pthread_detach(thread);
+}
+
+/* Runs other tasks until t is done, sleeping while there are none. */
+void sched_wait(sched_task *t) {
+	sched_pool *p = &sched_global;
+	int running;
+	while( __atomic_load_n(&t->done, __ATOMIC_ACQUIRE) != SCHED_DONE ) {
+		sched_task *o = sched_take();
+		if( o ) { o->run(o); continue; }
+		pthread_mutex_lock(&p->idle_lock);
+		running = SCHED_RUNNING;
+		__atomic_compare_exchange_n(&t->done, &running, SCHED_JOINED, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+		__atomic_fetch_add(&p->idle, 1, __ATOMIC_SEQ_CST);
+		while( __atomic_load_n(&t->done, __ATOMIC_ACQUIRE) != SCHED_DONE && !__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) )
+			pthread_cond_wait(&p->wake, &p->idle_lock);
+		__atomic_fetch_sub(&p->idle, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&p->idle_lock);
+	}
+}
+
+#endif //_POOL_H
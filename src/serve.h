@@ -0,0 +1,285 @@
+#ifndef _SERVE_H
+#define _SERVE_H
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "vm.h"
+
+/*
+// polish --serve path listens on a Unix domain socket at path and runs a program for
+// each connection to it, so that a request pays neither for starting a process nor for
+// loading its program. A request is the path of a .pbc file, a newline and the bytes of
+// its standard input, up to where the client shuts its side down for writing. The
+// response is the output, streamed as the program writes it in chunks each preceded by
+// its length as a 4 byte unsigned integer, then a chunk of length 0 and the error of
+// the run, empty if it ended well, up to where the server closes the connection.
+//
+// Programs are kept loaded by path and loaded again when the size or modification time
+// of their file changes; the VMs that ran a program are kept with it, to be reset and
+// reused. At most SERVE_MAX_PROGS programs are kept, the one used longest ago going
+// first; a program is loaded outside the lock of the pool, so a load holds up no other
+// request, and two requests for a program not kept may both load it.
+//
+// The server runs as many requests at once as polish --jobs N says, by default one per
+// CPU, each on a thread of its own. polish --send path file.pbc is the client: it sends
+// its standard input and writes the output as polish file.pbc would. The output goes
+// through fopencookie(), so _GNU_SOURCE is defined before anything is included.
+*/
+#define SERVE_BACKLOG 128
+#define SERVE_MAX_PROGS 64
+
+/* A loaded program and the spare VMs that ran it. */
+typedef struct serve_prog {
+	char *path;
+	struct timespec mtime;
+	off_t size;
+	polish_prog *p;
+	polish_vm **spare;
+	size_t spare_len, spare_cap;
+	unsigned refs;		/* the requests running it, and one while it is kept */
+	struct serve_prog *next;
+} serve_prog;
+
+typedef struct {
+	int fd;
+	serve_prog *progs;		/* the most recently used first */
+	size_t prog_count;
+	int str_track;
+	size_t heap_cap;
+	pthread_mutex_t lock;
+} serve_pool;
+
+/* Sends all len bytes at buf; returns -1 if the connection is gone. */
+int __serve_send(const int fd, const void *buf, size_t len) {
+	const char *c = buf;
+	while( len ) {
+		ssize_t n = send(fd, c, len, MSG_NOSIGNAL);
+		if( n < 0 ) return -1;
+		c += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Reads len bytes to buf; returns -1 if the connection ends first. */
+int __serve_recv(const int fd, void *buf, size_t len) {
+	char *c = buf;
+	while( len ) {
+		ssize_t n = recv(fd, c, len, 0);
+		if( n <= 0 ) return -1;
+		c += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int __serve_chunk(const int fd, const char *buf, const size_t len) {
+	const uint32_t n = len;
+	return __serve_send(fd, &n, sizeof(n)) || __serve_send(fd, buf, len) ? -1 : 0;
+}
+
+/* Ends a response with the error msg, empty if the run ended well. */
+void __serve_end(const int fd, const char *msg) {
+	if( !__serve_chunk(fd, msg, 0) ) __serve_send(fd, msg, strlen(msg));
+}
+
+/* The write of the stream a request's output goes to: each buffer full is a chunk. */
+ssize_t __serve_write(void *cookie, const char *buf, size_t len) {
+	if( !len ) return 0;
+	return __serve_chunk(*(int*) cookie, buf, len) ? -1 : (ssize_t) len;
+}
+
+/* Drops a reference to x, freeing it with its VMs after the last; the caller holds the lock. */
+void __serve_drop(serve_prog *x) {
+	if( --x->refs ) return;
+	for( size_t i = 0; i < x->spare_len; i++ ) polish_destroy(x->spare[i]);
+	polish_prog_free(x->p);
+	free(x->spare);
+	free(x->path);
+	free(x);
+}
+
+/* Takes the program kept for path out of the list and returns it, or 0 if there is none;
+if it is not of the file st describes it is dropped and 0 returned. The caller holds the
+lock. */
+serve_prog *__serve_take(serve_pool *s, const char *path, const struct stat *st) {
+	serve_prog **at = &s->progs, *x;
+	while( (x = *at) && strcmp(x->path, path) ) at = &x->next;
+	if( !x ) return 0;
+	*at = x->next;
+	s->prog_count--;
+	if( x->size == st->st_size && x->mtime.tv_sec == st->st_mtim.tv_sec && x->mtime.tv_nsec == st->st_mtim.tv_nsec ) return x;
+	__serve_drop(x);
+	return 0;
+}
+
+/* Puts x first in the list and drops the last program if that makes too many. The
+caller holds the lock. */
+void __serve_keep(serve_pool *s, serve_prog *x) {
+	serve_prog **at = &s->progs;
+	x->next = s->progs;
+	s->progs = x;
+	if( ++s->prog_count <= SERVE_MAX_PROGS ) return;
+	while( (*at)->next ) at = &(*at)->next;
+	__serve_drop(*at);
+	*at = 0;
+	s->prog_count--;
+}
+
+/* The program at path, loaded again if its file changed since it was kept, or 0 if it
+won't load; the caller holds a reference to it until __serve_drop(). */
+serve_prog *__serve_prog(serve_pool *s, const char *path) {
+	struct stat st;
+	serve_prog *x, *y;
+	polish_prog *p;
+	if( stat(path, &st) ) return 0;
+	pthread_mutex_lock(&s->lock);
+	if( (x = __serve_take(s, path, &st)) ) {
+		__serve_keep(s, x);
+		x->refs++;
+	}
+	pthread_mutex_unlock(&s->lock);
+	if( x ) return x;
+	if( !(p = polish_load_file(path)) ) return 0;
+	x = calloc(1, sizeof(serve_prog));
+	*x = (serve_prog) { .path = strdup(path), .mtime = st.st_mtim, .size = st.st_size, .p = p, .refs = 2 };
+	pthread_mutex_lock(&s->lock);
+	/* Another request may have loaded the same file meanwhile; its copy is kept. */
+	if( (y = __serve_take(s, path, &st)) ) {
+		x->refs = 1;
+		__serve_drop(x);
+		x = y;
+		x->refs++;
+	}
+	__serve_keep(s, x);
+	pthread_mutex_unlock(&s->lock);
+	return x;
+}
+
+/* Runs the request on the connection fd and closes it. */
+void __serve_conn(serve_pool *s, const int fd) {
+	FILE *req = fdopen(fd, "r"), *in = 0, *out;
+	char *path = 0, *buf = 0, msg[ERR_EXTRA_LEN + 64] = "", chunk[BUFSIZ];
+	size_t path_cap = 0, len = 0, n;
+	ssize_t path_len = getline(&path, &path_cap, req);
+	if( path_len <= 0 || path[path_len - 1] != '\n' ) goto done;
+	path[path_len - 1] = 0;
+	/* The input is read in full before the run, so that a client that sends it all
+	before it reads is never stuck on a server stuck sending it the output. */
+	in = open_memstream(&buf, &len);
+	while( (n = fread(chunk, 1, sizeof(chunk), req)) ) fwrite(chunk, 1, n, in);
+	fclose(in);
+	in = fmemopen(buf, len, "r");
+	serve_prog *x = __serve_prog(s, path);
+	if( !x ) {
+		snprintf(msg, sizeof(msg), "File %.*s not found.", ERR_EXTRA_LEN, path);
+		__serve_end(fd, msg);
+		goto done;
+	}
+	pthread_mutex_lock(&s->lock);
+	polish_vm *v = x->spare_len ? x->spare[--x->spare_len] : 0;
+	pthread_mutex_unlock(&s->lock);
+	if( v )	polish_reset(v);
+	else	v = polish_create(x->p);
+	heap_stats stats = { .cap = s->heap_cap };
+	out = fopencookie((void*) &fd, "w", (cookie_io_functions_t) { .write = __serve_write });
+	v->heap->stats = s->heap_cap ? &stats : 0;
+	polish_set_io(v, in, out);
+	polish_set_strtrack(v, s->str_track);
+	if( polish_run(v) ) snprintf(msg, sizeof(msg), "%s", polish_error(v));
+	fclose(out);
+	v->heap->stats = 0;
+	free(stats.sites);
+	__serve_end(fd, msg);
+	pthread_mutex_lock(&s->lock);
+	if( x->spare_len == x->spare_cap ) x->spare = realloc(x->spare, (x->spare_cap = x->spare_cap*2 + 4)*sizeof(polish_vm*));
+	x->spare[x->spare_len++] = v;
+	__serve_drop(x);
+	pthread_mutex_unlock(&s->lock);
+done:
+	if( in ) fclose(in);
+	free(buf);
+	free(path);
+	fclose(req);
+}
+
+void *__serve_worker(void *arg) {
+	serve_pool *s = arg;
+	for( ;; ) {
+		int fd = accept(s->fd, 0, 0);
+		if( fd >= 0 ) __serve_conn(s, fd);
+	}
+	return 0;
+}
+
+int __serve_addr(struct sockaddr_un *addr, const char *path) {
+	*addr = (struct sockaddr_un) { .sun_family = AF_UNIX };
+	if( strlen(path) >= sizeof(addr->sun_path) ) return -1;
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+/* Serves requests on the socket at path on threads threads, or one per CPU if it is
+0; returns only if the socket won't open, with the error on standard error. */
+int serve(const char *path, unsigned threads, const int str_track, const size_t heap_cap) {
+	serve_pool s = { .str_track = str_track, .heap_cap = heap_cap };
+	struct sockaddr_un addr;
+	struct stat st;
+	if( __serve_addr(&addr, path) ) { fprintf(stderr, "Socket path %s is too long.\n", path); return 1; }
+	s.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	/* A socket left by an earlier server is replaced; anything else at path is left alone. */
+	if( !lstat(path, &st) && S_ISSOCK(st.st_mode) ) unlink(path);
+	if( s.fd < 0 || bind(s.fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(s.fd, SERVE_BACKLOG) ) {
+		fprintf(stderr, "Couldn't listen on %s.\n", path);
+		return 1;
+	}
+	if( !threads ) threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	pthread_mutex_init(&s.lock, 0);
+	for( unsigned t = 1; t < threads; t++ ) {
+		pthread_t worker;
+		pthread_create(&worker, 0, __serve_worker, &s);
+		pthread_detach(worker);
+	}
+	__serve_worker(&s);
+	return 0;
+}
+
+/* Sends a request to run pbc_path on in to the server at sock and writes the output to
+out; returns 0, or 1 if the run failed, with the error written to out as polish writes
+it, or -1 if the server can't be reached. */
+int serve_request(const char *sock, const char *pbc_path, FILE *in, FILE *out) {
+	struct sockaddr_un addr;
+	char *path = realpath(pbc_path, 0), buf[BUFSIZ];
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0), err = -1;
+	size_t n;
+	ssize_t got;
+	uint32_t len;
+	if( fd < 0 || __serve_addr(&addr, sock) || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) ) goto done;
+	if( __serve_send(fd, path ? path : pbc_path, strlen(path ? path : pbc_path)) || __serve_send(fd, "\n", 1) ) goto done;
+	while( (n = fread(buf, 1, sizeof(buf), in)) ) if( __serve_send(fd, buf, n) ) goto done;
+	shutdown(fd, SHUT_WR);
+	for( ;; ) {
+		if( __serve_recv(fd, &len, sizeof(len)) ) goto done;
+		if( !len ) break;
+		for( ; len; len -= n ) {
+			n = len < sizeof(buf) ? len : sizeof(buf);
+			if( __serve_recv(fd, buf, n) ) goto done;
+			fwrite(buf, 1, n, out);
+		}
+	}
+	err = 0;
+	while( (got = recv(fd, buf, sizeof(buf), 0)) > 0 ) {
+		fwrite(buf, 1, got, out);
+		err = 1;
+	}
+	if( err ) fputc('\n', out);
+done:
+	if( fd >= 0 ) close(fd);
+	free(path);
+	return err;
+}
+
+#endif //_SERVE_H
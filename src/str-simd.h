@@ -0,0 +1,239 @@
+#ifndef _STR_SIMD_H
+#define _STR_SIMD_H
+#include <stddef.h>
+
+/*
+// Byte-string kernels used by the string operations of the VM.
+// Every kernel has a scalar version, and on x86 an SSE2 and an AVX2 version;
+// the str_* function pointers are set by str_simd_init() to the widest
+// version the running CPU supports and default to the SSE2 (or scalar) one.
+//
+// str_rzero(p, n)			index of the last zero byte in p[0..n), or -1
+// str_chr(p, n, c)			index of the first c in p[0..n), or -1
+// str_cmp(a, b, n)			difference of the first mismatching bytes, or 0
+// str_upper(p, n)			ascii lowercase letters in p[0..n) to uppercase
+// str_lower(p, n)			ascii uppercase letters in p[0..n) to lowercase
+// str_rev(p, n)			reverse p[0..n) in place
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STR_SIMD_X86
+#endif
+
+long __str_rzero_scalar(const char *p, size_t n) {
+	while( n-- ) if( !p[n] )					return n;
+	return -1;
+}
+
+long __str_chr_scalar(const char *p, size_t n, const char c) {
+	for( size_t i = 0; i < n; i++ ) if( p[i] == c ) return i;
+	return -1;
+}
+
+int __str_cmp_scalar(const char *a, const char *b, size_t n) {
+	for( size_t i = 0; i < n; i++ )
+		if( a[i] != b[i] ) return (unsigned char) a[i] - (unsigned char) b[i];
+	return 0;
+}
+
+void __str_upper_scalar(char *p, size_t n) {
+	for( size_t i = 0; i < n; i++ ) if( p[i] >= 'a' && p[i] <= 'z' ) p[i] -= 'a' - 'A';
+}
+
+void __str_lower_scalar(char *p, size_t n) {
+	for( size_t i = 0; i < n; i++ ) if( p[i] >= 'A' && p[i] <= 'Z' ) p[i] += 'a' - 'A';
+}
+
+void __str_rev_scalar(char *p, size_t n) {
+	if( n < 2 ) return;
+	for( size_t i = 0, j = n - 1; i < j; i++, j-- ) { char t = p[i]; p[i] = p[j]; p[j] = t; }
+}
+
+#ifdef STR_SIMD_X86
+/* The SSE2 kernels are always inlined so that the tails of the AVX2 kernels
+are compiled with VEX encoding and do not pay for SSE/AVX transitions.
+Ascii case mapping adds a bias so that the 26 letters of the source case are
+the 26 smallest signed bytes, then one signed compare picks them out. */
+
+__attribute__((always_inline)) static inline
+long __str_rzero_sse2(const char *p, size_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	while( n >= 16 ) {
+		n -= 16;
+		unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + n)), zero));
+		if( m )									return n + 31 - __builtin_clz(m);
+	}
+	return __str_rzero_scalar(p, n);
+}
+
+__attribute__((always_inline)) static inline
+long __str_chr_sse2(const char *p, size_t n, const char c) {
+	const __m128i needle = _mm_set1_epi8(c);
+	size_t i = 0;
+	for( ; i + 16 <= n; i += 16 ) {
+		unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i)), needle));
+		if( m )									return i + __builtin_ctz(m);
+	}
+	long r = __str_chr_scalar(p + i, n - i, c);
+	return r < 0 ? r : (long) i + r;
+}
+
+__attribute__((always_inline)) static inline
+int __str_cmp_sse2(const char *a, const char *b, size_t n) {
+	size_t i = 0;
+	for( ; i + 16 <= n; i += 16 ) {
+		unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*) (a + i)), _mm_loadu_si128((const __m128i*) (b + i))
+		)) ^ 0xFFFF;
+		if( m ) {
+			i += __builtin_ctz(m);				return (unsigned char) a[i] - (unsigned char) b[i];
+		}
+	}
+	return __str_cmp_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((always_inline)) static inline void __str_case_sse2(char *p, size_t n, const char first) {
+	const __m128i bias = _mm_set1_epi8((char) (0x80 - first));
+	const __m128i limit = _mm_set1_epi8(-128 + 26);
+	const __m128i flip = _mm_set1_epi8(0x20);
+	size_t i = 0;
+	for( ; i + 16 <= n; i += 16 ) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (p + i));
+		__m128i m = _mm_cmplt_epi8(_mm_add_epi8(x, bias), limit);
+		_mm_storeu_si128((__m128i*) (p + i), _mm_xor_si128(x, _mm_and_si128(m, flip)));
+	}
+	if( first == 'a' )	__str_upper_scalar(p + i, n - i);
+	else				__str_lower_scalar(p + i, n - i);
+}
+void __str_upper_sse2(char *p, size_t n) { __str_case_sse2(p, n, 'a'); }
+void __str_lower_sse2(char *p, size_t n) { __str_case_sse2(p, n, 'A'); }
+
+/* SSE2 has no byte shuffle: swap the bytes of every word, then reverse the words. */
+__attribute__((always_inline)) static inline __m128i __rev_bytes_sse2(__m128i x) {
+	x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((always_inline)) static inline
+void __str_rev_sse2(char *p, size_t n) {
+	size_t i = 0, j = n;
+	while( j - i >= 32 ) {
+		__m128i lo = _mm_loadu_si128((const __m128i*) (p + i));
+		__m128i hi = _mm_loadu_si128((const __m128i*) (p + j - 16));
+		_mm_storeu_si128((__m128i*) (p + i), __rev_bytes_sse2(hi));
+		_mm_storeu_si128((__m128i*) (p + j - 16), __rev_bytes_sse2(lo));
+		i += 16; j -= 16;
+	}
+	__str_rev_scalar(p + i, j - i);
+}
+
+__attribute__((target("avx2")))
+long __str_rzero_avx2(const char *p, size_t n) {
+	const __m256i zero = _mm256_setzero_si256();
+	while( n >= 32 ) {
+		n -= 32;
+		unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (p + n)), zero));
+		if( m )									return n + 31 - __builtin_clz(m);
+	}
+	return __str_rzero_sse2(p, n);
+}
+
+__attribute__((target("avx2")))
+long __str_chr_avx2(const char *p, size_t n, const char c) {
+	const __m256i needle = _mm256_set1_epi8(c);
+	size_t i = 0;
+	for( ; i + 32 <= n; i += 32 ) {
+		unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (p + i)), needle));
+		if( m )									return i + __builtin_ctz(m);
+	}
+	long r = __str_chr_sse2(p + i, n - i, c);
+	return r < 0 ? r : (long) i + r;
+}
+
+__attribute__((target("avx2")))
+int __str_cmp_avx2(const char *a, const char *b, size_t n) {
+	size_t i = 0;
+	for( ; i + 32 <= n; i += 32 ) {
+		unsigned m = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i*) (a + i)), _mm256_loadu_si256((const __m256i*) (b + i))
+		));
+		if( m ) {
+			i += __builtin_ctz(m);				return (unsigned char) a[i] - (unsigned char) b[i];
+		}
+	}
+	return __str_cmp_sse2(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline void __str_case_avx2(char *p, size_t n, const char first) {
+	const __m256i bias = _mm256_set1_epi8((char) (0x80 - first));
+	const __m256i limit = _mm256_set1_epi8(-128 + 26);
+	const __m256i flip = _mm256_set1_epi8(0x20);
+	size_t i = 0;
+	for( ; i + 32 <= n; i += 32 ) {
+		__m256i x = _mm256_loadu_si256((const __m256i*) (p + i));
+		__m256i m = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(x, bias));
+		_mm256_storeu_si256((__m256i*) (p + i), _mm256_xor_si256(x, _mm256_and_si256(m, flip)));
+	}
+	__str_case_sse2(p + i, n - i, first);
+}
+__attribute__((target("avx2"))) void __str_upper_avx2(char *p, size_t n) { __str_case_avx2(p, n, 'a'); }
+__attribute__((target("avx2"))) void __str_lower_avx2(char *p, size_t n) { __str_case_avx2(p, n, 'A'); }
+
+__attribute__((target("avx2")))
+static inline __m256i __rev_bytes_avx2(__m256i x) {
+	const __m256i rev = _mm256_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+	);
+	return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(x, rev), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2")))
+void __str_rev_avx2(char *p, size_t n) {
+	size_t i = 0, j = n;
+	while( j - i >= 64 ) {
+		__m256i lo = _mm256_loadu_si256((const __m256i*) (p + i));
+		__m256i hi = _mm256_loadu_si256((const __m256i*) (p + j - 32));
+		_mm256_storeu_si256((__m256i*) (p + i), __rev_bytes_avx2(hi));
+		_mm256_storeu_si256((__m256i*) (p + j - 32), __rev_bytes_avx2(lo));
+		i += 32; j -= 32;
+	}
+	__str_rev_sse2(p + i, j - i);
+}
+
+long (*str_rzero)(const char*, size_t)			= __str_rzero_sse2;
+long (*str_chr)(const char*, size_t, const char)= __str_chr_sse2;
+int  (*str_cmp)(const char*, const char*, size_t)= __str_cmp_sse2;
+void (*str_upper)(char*, size_t)				= __str_upper_sse2;
+void (*str_lower)(char*, size_t)				= __str_lower_sse2;
+void (*str_rev)(char*, size_t)					= __str_rev_sse2;
+
+void str_simd_init(void) {
+	__builtin_cpu_init();
+	if( !__builtin_cpu_supports("avx2") ) return;
+	str_rzero = __str_rzero_avx2;
+	str_chr = __str_chr_avx2;
+	str_cmp = __str_cmp_avx2;
+	str_upper = __str_upper_avx2;
+	str_lower = __str_lower_avx2;
+	str_rev = __str_rev_avx2;
+}
+
+#else
+
+long (*str_rzero)(const char*, size_t)			= __str_rzero_scalar;
+long (*str_chr)(const char*, size_t, const char)= __str_chr_scalar;
+int  (*str_cmp)(const char*, const char*, size_t)= __str_cmp_scalar;
+void (*str_upper)(char*, size_t)				= __str_upper_scalar;
+void (*str_lower)(char*, size_t)				= __str_lower_scalar;
+void (*str_rev)(char*, size_t)					= __str_rev_scalar;
+
+void str_simd_init(void) {}
+
+#endif //STR_SIMD_X86
+
+#endif //_STR_SIMD_H
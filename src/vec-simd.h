@@ -0,0 +1,112 @@
+#ifndef _VEC_SIMD_H
+#define _VEC_SIMD_H
+#include <stddef.h>
+#include <string.h>
+
+/*
+// Kernels of the vector operations over arrays of c, r, i or l elements, indexed by
+// the operation and the log2 of the element size. They are written with the
+// compiler's generic vectors, 16 bytes wide for SSE2 and 32 bytes wide for AVX2,
+// and finish the elements past the last whole vector one at a time; off x86 the
+// compiler lowers the 16 byte vectors to whatever the target has.
+// vec_simd_init() switches the tables to the AVX2 kernels if the CPU has AVX2.
+//
+// vec_binop[VEC_ADD..VEC_CMP][w](dst, src, n)	dst[i] = dst[i] op src[i]
+// vec_reduce[VEC_SUM..VEC_MAX][w](p, n)			sum, minimum or maximum of p[0..n)
+//
+// Elements are unsigned and arithmetic wraps; VEC_CMP stores 1 where src[i] is
+// greater, all ones where it is less and 0 where it is equal, as Xcmp does.
+*/
+
+enum { VEC_ADD, VEC_SUB, VEC_MUL, VEC_CMP };
+enum { VEC_SUM, VEC_MIN, VEC_MAX };
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VEC_SIMD_X86
+#define __VEC_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define __VEC_TYPES(N) \
+	typedef unsigned char	__v##N##c __attribute__((vector_size(N), aligned(1), may_alias)); \
+	typedef unsigned short	__v##N##r __attribute__((vector_size(N), aligned(1), may_alias)); \
+	typedef unsigned int	__v##N##i __attribute__((vector_size(N), aligned(1), may_alias)); \
+	typedef unsigned long	__v##N##l __attribute__((vector_size(N), aligned(1), may_alias));
+__VEC_TYPES(16)
+__VEC_TYPES(32)
+
+#define __VEC_BINOP(name, T, V, vexpr, sexpr, attr) \
+	attr void name(void *dst_, const void *src_, size_t n) { \
+		T *dst = dst_; \
+		const T *src = src_; \
+		size_t i = 0; \
+		for( ; i + sizeof(V)/sizeof(T) <= n; i += sizeof(V)/sizeof(T) ) { \
+			V a = *(V*) (dst + i), b = *(const V*) (src + i); \
+			*(V*) (dst + i) = vexpr; \
+		} \
+		for( ; i < n; i++ ) { \
+			T a = dst[i], b = src[i]; \
+			dst[i] = sexpr; \
+		} \
+	}
+
+#define __VEC_REDUCE(name, T, V, init, vexpr, sexpr, attr) \
+	attr unsigned long name(const void *p_, size_t n) { \
+		const T *p = p_; \
+		V acc = (V) {0} + (T) (init), x; \
+		T r = (init), a, b; \
+		size_t i = 0; \
+		for( ; i + sizeof(V)/sizeof(T) <= n; i += sizeof(V)/sizeof(T) ) { \
+			x = *(const V*) (p + i); \
+			acc = vexpr; \
+		} \
+		for( unsigned j = 0; j < sizeof(V)/sizeof(T); j++ ) { a = r; b = acc[j]; r = sexpr; } \
+		for( ; i < n; i++ ) { a = r; b = p[i]; r = sexpr; } \
+		return r; \
+	}
+
+#define __VEC_KERNELS(suffix, N, T, V, attr) \
+	__VEC_BINOP(__vec_add_##suffix, T, V, a + b, a + b, attr) \
+	__VEC_BINOP(__vec_sub_##suffix, T, V, a - b, a - b, attr) \
+	__VEC_BINOP(__vec_mul_##suffix, T, V, a * b, a * b, attr) \
+	__VEC_BINOP(__vec_cmp_##suffix, T, V, ((V) (b > a) & 1) | (V) (b < a), b > a ? 1 : b < a ? (T) -1 : 0, attr) \
+	__VEC_REDUCE(__vec_sum_##suffix, T, V, 0, acc + x, a + b, attr) \
+	__VEC_REDUCE(__vec_min_##suffix, T, V, -1, (x & (V) (x < acc)) | (acc & ~(V) (x < acc)), b < a ? b : a, attr) \
+	__VEC_REDUCE(__vec_max_##suffix, T, V, 0, (x & (V) (x > acc)) | (acc & ~(V) (x > acc)), b > a ? b : a, attr)
+
+#define __VEC_WIDTHS(isa, N, attr) \
+	__VEC_KERNELS(c_##isa, N, unsigned char, __v##N##c, attr) \
+	__VEC_KERNELS(r_##isa, N, unsigned short, __v##N##r, attr) \
+	__VEC_KERNELS(i_##isa, N, unsigned int, __v##N##i, attr) \
+	__VEC_KERNELS(l_##isa, N, unsigned long, __v##N##l, attr)
+
+__VEC_WIDTHS(sse2, 16, )
+
+#define __VEC_TABLE(op, isa) { __vec_##op##_c_##isa, __vec_##op##_r_##isa, __vec_##op##_i_##isa, __vec_##op##_l_##isa }
+
+void (*vec_binop[4][4])(void*, const void*, size_t) = {
+	__VEC_TABLE(add, sse2), __VEC_TABLE(sub, sse2), __VEC_TABLE(mul, sse2), __VEC_TABLE(cmp, sse2),
+};
+unsigned long (*vec_reduce[3][4])(const void*, size_t) = {
+	__VEC_TABLE(sum, sse2), __VEC_TABLE(min, sse2), __VEC_TABLE(max, sse2),
+};
+
+#ifdef VEC_SIMD_X86
+__VEC_WIDTHS(avx2, 32, __VEC_AVX2)
+
+void vec_simd_init(void) {
+	void (*binop[4][4])(void*, const void*, size_t) = {
+		__VEC_TABLE(add, avx2), __VEC_TABLE(sub, avx2), __VEC_TABLE(mul, avx2), __VEC_TABLE(cmp, avx2),
+	};
+	unsigned long (*reduce[3][4])(const void*, size_t) = {
+		__VEC_TABLE(sum, avx2), __VEC_TABLE(min, avx2), __VEC_TABLE(max, avx2),
+	};
+	__builtin_cpu_init();
+	if( !__builtin_cpu_supports("avx2") ) return;
+	memcpy(vec_binop, binop, sizeof(binop));
+	memcpy(vec_reduce, reduce, sizeof(reduce));
+}
+#else
+void vec_simd_init(void) {}
+#endif //VEC_SIMD_X86
+
+#endif //_VEC_SIMD_H
@@ -0,0 +1,1593 @@
+#ifndef _VM_H
+#define _VM_H
+#include "libpolish.h"
+#include "common.h"
+#include "fmt-lex.h"
+#include "str-simd.h"
+#include "pbc.h"
+#include "heap.h"
+#include "vec-simd.h"
+#include "pool.h"
+#include "chan.h"
+
+/*
+// The virtual machine. Everything a run changes lives in its polish_vm, and the
+// polish_prog it runs is only read, so that VMs may run side by side in any threads;
+// the only state shared between them is the SIMD kernels, picked once by the first
+// polish_load_*.
+//
+// spawn runs a task in a VM of its own on the pool of src/pool.h. A task has its own
+// stacks and registers but shares the heap, in and out with the VM that spawned it;
+// from the first spawn on, the heap is used under a lock. Every task must be joined
+// before the VM that spawned it ends, as join frees the VM of the task. Tasks pass
+// messages through the channels of src/chan.h, which are blocks of the heap.
+*/
+#define STACK_SIZE 256
+#define RET_STACK_SIZE 256
+#define LOOP_REGS 16
+
+/* String tracking (polish --strtrack) keeps a side stack with an entry per string on
+the data stack: the offset of its zero byte, and the offset up to which its bytes are
+known to be nonzero. Operations which change bytes of the data stack other than by
+pushing lower str_lwm to the lowest offset they touched; entries above it are dropped
+or cut short the next time the side stack is used, and any bytes above the top entry
+are scanned as before. */
+typedef struct {
+	size_t start;
+	size_t end;
+} str_bound;
+
+/* A counted loop held in a loop register: loop starts it, and next counts the index
+up and jumps back to the instruction after loop until the index passes the limit. */
+typedef struct {
+	t_lnum index, limit;
+	size_t start;
+} loop_reg;
+
+struct polish_prog {
+	stack code;							/* the bytecode, without the sections */
+	pbc_section sections[PBC_SEC_MAX];	/* formats compiled by polishc are in PBC_SEC_FMT */
+};
+
+struct polish_vm {
+	const polish_prog *prog;
+	stack data;
+	size_t ret_stack[RET_STACK_SIZE], ret_head;
+	loop_reg loops[LOOP_REGS];
+	size_t loop_depth;
+	size_t pc;						/* where exec starts, or resumes */
+	unsigned long slice;			/* see slice_spent() */
+	long budget;
+	heap *heap;						/* own_heap, or that of the VM which spawned the task */
+	heap own_heap;
+	pthread_mutex_t *heap_lock;		/* set by the first spawn or pfor */
+	FILE *in, *out;
+	int str_track;
+	str_bound *str_bounds;
+	size_t str_count, str_hint, str_lwm;
+	/* sfmt formats into fmt_scratch in one pass over the format string, reading the
+	arguments downward from below it, and then copies the result over the format string. */
+	char fmt_scratch[STACK_SIZE];
+	char err_extra[ERR_EXTRA_LEN];
+	char err_msg[ERR_EXTRA_LEN + 64];
+};
+typedef struct polish_vm vm;
+
+int exec(vm *v);
+
+/* With a slice, polish_run() gives the VM a budget of about that many instructions,
+charged at back-edges, jumps and nexts which go back, by the instructions they go back
+over. exec checks it only there, after the jump, and before sgetf and sputf, which may
+block and cost one, and returns POLISH_SUSPENDED once it is spent, to be resumed by the
+next run. Returns 1 if the budget is spent. */
+int slice_spent(vm *v, const size_t cost) {
+	return v->slice && (v->budget -= cost) <= 0;
+}
+
+void str_touch(vm *v, const size_t at) {
+	if( at < v->str_lwm ) v->str_lwm = at;
+}
+
+int push_num(vm *v, const t_lnum i, const unsigned size) {
+	stack *s = &v->data;
+	if( s->head + size >= STACK_SIZE ) {
+		sprintf(v->err_extra, "PUSH %lu (size %u)", i, size);				return RERR_SOVERFLOW;
+	}
+	memcpy(s->data + s->head, &i, size);
+	s->head += size;
+	return 0;
+}
+
+int pop_num(vm *v, t_lnum *i, const unsigned size) {
+	stack *s = &v->data;
+	if( s->head < size ) {
+		sprintf(v->err_extra, "POP size %u, SP @ %lu", size, s->head);		return RERR_SUNDERFLOW;
+	}
+	s->head -= size;
+	str_touch(v, s->head);
+	if( i ) memcpy(i, s->data + s->head, size);
+	return 0;
+}
+
+int peek_num(vm *v, t_lnum *i, const unsigned depth, const unsigned size) {
+	stack *s = &v->data;
+	if( s->head < depth ) {
+		sprintf(v->err_extra, "peek depth %u, SP @ %lu", depth, s->head);	return RERR_SUNDERFLOW;
+	}
+	if( depth < size ) {
+		sprintf(v->err_extra, "peek depth %u < %u", depth, size);			return RERR_SUNDERFLOW;
+	}
+	memcpy(i, s->data + s->head - depth, size);
+	return 0;
+}
+
+int pop_bargs(vm *v, t_lnum *lhs, t_lnum *rhs, const unsigned size) {
+	int RERR;
+	if( (RERR = pop_num(v, rhs, size)) )								return RERR;
+	if( (RERR = pop_num(v, lhs, size)) )								return RERR;
+	return 0;
+}
+
+void str_sync(vm *v) {
+	const stack *s = &v->data;
+	while( v->str_count && v->str_bounds[v->str_count - 1].start >= v->str_lwm ) v->str_count--;
+	if( v->str_count && v->str_bounds[v->str_count - 1].end > v->str_lwm ) v->str_bounds[v->str_count - 1].end = v->str_lwm;
+	v->str_lwm = s->head;
+}
+
+/* Records that the string with its zero byte at start now ends at end, and that
+anything above start has been rewritten. */
+void str_mark(vm *v, const size_t start, const size_t end) {
+	if( !v->str_track ) return;
+	str_touch(v, start);
+	str_sync(v);
+	v->str_bounds[v->str_count++] = (str_bound) { start, end };
+}
+
+/* Keeps the side stack current across the character pushes of string literals. */
+void str_push_char(vm *v, const t_lnum c) {
+	const stack *s = &v->data;
+	str_sync(v);
+	if( c == 0 )
+		v->str_bounds[v->str_count++] = (str_bound) { s->head - 1, s->head };
+	else if( v->str_count && v->str_bounds[v->str_count - 1].end == s->head - 1 )
+		v->str_bounds[v->str_count - 1].end++;
+}
+
+/* Returns the offset of the zero byte of the string ending at height, or -1.
+Lookups at the top of the stack start from the top entry, lookups below it from the
+entry last found, so walking down a run of strings costs O(1) per string. */
+long str_find_tracked(vm *v, const size_t height) {
+	const stack *s = &v->data;
+	size_t i;
+	long zero;
+	str_sync(v);
+	i = height == s->head || v->str_hint >= v->str_count ? v->str_count : v->str_hint + 1;
+	while( i < v->str_count && v->str_bounds[i].start < height ) i++;
+	while( i && v->str_bounds[i - 1].start >= height ) i--;
+	if( i == 0 ) {
+		zero = str_rzero(s->data, height);
+		if( zero >= 0 && height == s->head ) v->str_bounds[v->str_count++] = (str_bound) { zero, height };
+		return zero;
+	}
+	str_bound *e = v->str_bounds + (v->str_hint = i - 1);
+	if( e->end >= height )									return e->start;
+	zero = str_rzero(s->data + e->end, height - e->end);
+	if( height != s->head )			return zero < 0 ? (long) e->start : (long) e->end + zero;
+	if( zero < 0 ) { e->end = height;						return e->start; }
+	zero += e->end;
+	v->str_bounds[v->str_count++] = (str_bound) { zero, height };
+	return zero;
+}
+
+/* Returns depth of the zero character relative to s->head - depth,
+i.e., if the zero is top of stack (s->data + s->head - 1) and depth is 0, returns 0;
+if the zero is third from the top (s->data + s->head - 3) and depth is 1, returns 1;
+Note also that s->data + s->head has nothing (has not been written to),
+so the search covers s->data up to but not including s->data + s->head - depth. */
+int find_str(vm *v, const size_t depth, size_t *count) {
+	const stack *s = &v->data;
+	long zero = -1;
+	if( depth < s->head ) {
+		if( v->str_track )	zero = str_find_tracked(v, s->head - depth);
+		else			zero = str_rzero(s->data, s->head - depth);
+	}
+	if( zero < 0 ) {
+		sprintf(v->err_extra, "down from SP %lu", s->head - depth);		return RERR_RUNAWAYSTR;
+	}
+	*count = s->head - depth - zero - 1;
+	return 0;
+}
+
+int do_add(vm *v, const unsigned size) {
+	t_lnum rhs = 0, lhs = 0;
+	int RERR;
+	if( (RERR = pop_bargs(v, &lhs, &rhs, size)) )						return RERR;
+	push_num(v, rhs + lhs, size);
+	return 0;
+}
+int do_sub(vm *v, const unsigned size) {
+	t_lnum rhs = 0, lhs = 0;
+	int RERR;
+	if( (RERR = pop_bargs(v, &lhs, &rhs, size)) )						return RERR;
+	push_num(v, rhs - lhs, size);
+	return 0;
+}
+int do_mul(vm *v, const unsigned size) {
+	t_lnum rhs = 0, lhs = 0;
+	int RERR;
+	if( (RERR = pop_bargs(v, &lhs, &rhs, size)) )						return RERR;
+	push_num(v, rhs * lhs, size);
+	return 0;
+}
+int do_div(vm *v, const unsigned size) {
+	t_lnum rhs = 0, lhs = 0;
+	int RERR;
+	if( (RERR = pop_bargs(v, &lhs, &rhs, size)) )						return RERR;
+	push_num(v, rhs / lhs, size);
+	return 0;
+}
+
+int do_swp(vm *v, const unsigned size) {
+	t_lnum rhs = 0, lhs = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &rhs, size)) )								return RERR;
+	if( (RERR = pop_num(v, &lhs, size)) )								return RERR;
+#ifdef DEBUG
+	printf("\t\tswapping %016lX, %016lX, size %u\n", lhs, rhs, size);
+	print_stack(v->data);
+#endif
+	push_num(v, rhs, size);
+	push_num(v, lhs, size);
+	return 0;
+}
+
+int do_dup(vm *v, const unsigned size) {
+	t_lnum num = 0;
+	int RERR;
+	if( (RERR = peek_num(v, &num, size, size)) )						return RERR;
+#ifdef DEBUG
+	printf("\t\tduping %016lX, size %u\n", num, size);
+#endif
+	if( (RERR = push_num(v, num, size)) )								return RERR;
+	return 0;
+}
+
+int do_jmp(vm *v, const size_t prog_size, size_t *prog_p) {
+	t_lnum addr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	if( addr > prog_size ) {
+		sprintf(v->err_extra, "JMP to %lu, prog size %lu", addr, prog_size); return RERR_INV_JMP;
+	}
+	*prog_p = addr;
+	return 0;
+}
+
+/* call jumps like jmp and keeps the program pointer after it on the return stack,
+which ret pops to return there. */
+int do_call(vm *v, const size_t prog_size, size_t *prog_p) {
+	const size_t ret = *prog_p + 1;
+	int RERR;
+	if( v->ret_head == RET_STACK_SIZE ) {
+		sprintf(v->err_extra, "CALL @ PP %lu, %u calls deep", *prog_p, RET_STACK_SIZE);	return RERR_SOVERFLOW;
+	}
+	if( (RERR = do_jmp(v, prog_size, prog_p)) )							return RERR;
+	v->ret_stack[v->ret_head++] = ret;
+	return 0;
+}
+
+int do_ret(vm *v, size_t *prog_p) {
+	if( v->ret_head == 0 ) {
+		sprintf(v->err_extra, "RET @ PP %lu outside a call", *prog_p);		return RERR_SUNDERFLOW;
+	}
+	*prog_p = v->ret_stack[--v->ret_head];
+	return 0;
+}
+
+int do_loop(vm *v, const size_t prog_p) {
+	t_lnum start = 0, limit = 0;
+	int RERR;
+	if( v->loop_depth == LOOP_REGS ) {
+		sprintf(v->err_extra, "LOOP @ PP %lu, %u loops deep", prog_p, LOOP_REGS);	return RERR_SOVERFLOW;
+	}
+	if( (RERR = pop_bargs(v, &start, &limit, 8)) )						return RERR;
+	v->loops[v->loop_depth++] = (loop_reg) { start, limit, prog_p + 1 };
+	return 0;
+}
+
+int do_next(vm *v, size_t *prog_p) {
+	if( v->loop_depth == 0 ) {
+		sprintf(v->err_extra, "NEXT @ PP %lu outside a loop", *prog_p);	return RERR_SUNDERFLOW;
+	}
+	loop_reg *r = v->loops + v->loop_depth - 1;
+	if( ++r->index <= r->limit ) { *prog_p = r->start; return 0; }
+	v->loop_depth--;
+	(*prog_p)++;
+	return push_num(v, r->index, 8);
+}
+
+int do_index(vm *v, const size_t prog_p) {
+	if( v->loop_depth == 0 ) {
+		sprintf(v->err_extra, "INDEX @ PP %lu outside a loop", prog_p);	return RERR_SUNDERFLOW;
+	}
+	return push_num(v, v->loops[v->loop_depth - 1].index, 8);
+}
+
+/* A spawned task, run by a worker of the pool or by a thread waiting in join. */
+typedef struct {
+	sched_task t;
+	vm *v;
+	int err;
+} vm_task;
+
+void __vm_task_run(sched_task *t) {
+	vm_task *task = (vm_task*) t;
+	task->err = exec(task->v);
+	sched_done(t);
+}
+
+/* Makes the lock of the heap of v, which its tasks share; called before the first task
+is queued, as tasks read v->heap_lock without a lock. */
+void __heap_share(vm *v) {
+	if( v->heap_lock ) return;
+	v->heap_lock = malloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init(v->heap_lock, 0);
+}
+
+/* A VM for a task of v starting at pc, sharing its program, heap and handles. */
+vm *__task_vm(vm *v, const size_t pc) {
+	vm *c = polish_create(v->prog);
+	c->pc = pc;
+	c->heap = v->heap;
+	c->heap_lock = v->heap_lock;
+	polish_set_io(c, v->in, v->out);
+	polish_set_strtrack(c, v->str_track);
+	return c;
+}
+
+int do_spawn(vm *v, const size_t prog_size, const size_t prog_p) {
+	stack *s = &v->data;
+	t_lnum addr = 0, n = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	if( (RERR = pop_num(v, &n, 4)) )									return RERR;
+	if( addr >= prog_size ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "SPAWN @ PP %lu to %lu", prog_p, addr);	return RERR_INV_JMP;
+	}
+	if( n > s->head ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "SPAWN of %u bytes, SP @ %u", (unsigned) n, (unsigned) s->head);	return RERR_SUNDERFLOW;
+	}
+	vm_task *t = malloc(sizeof(vm_task));
+	__heap_share(v);
+	vm *c = t->v = __task_vm(v, addr);
+	s->head -= n;
+	str_touch(v, s->head);
+	memcpy(c->data.data, s->data + s->head, n);
+	c->data.head = n;
+	t->t.run = __vm_task_run;
+	sched_spawn(&t->t);
+	return push_num(v, (t_lnum) t, 8);
+}
+
+/* join fails with the error of the task if it failed. */
+int do_join(vm *v) {
+	stack *s = &v->data;
+	t_lnum addr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	vm_task *t = (vm_task*) addr;
+	sched_wait(&t->t);
+	const stack *out = &t->v->data;
+	if( (RERR = t->err) )
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "%.*s in task", ERR_EXTRA_LEN - 9, t->v->err_extra);
+	else if( s->head + out->head >= STACK_SIZE ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "JOIN of %lu bytes, SP @ %lu", out->head, s->head);
+		RERR = RERR_SOVERFLOW;
+	}
+	else {
+		memcpy(s->data + s->head, out->data, out->head);
+		s->head += out->head;
+	}
+	polish_destroy(t->v);
+	free(t);
+	return RERR;
+}
+
+/* pfor runs the routine at a label on each element of an array, with the element alone
+on the stack, and writes back what the routine leaves at end, which must be as wide.
+The calling thread and a task for each other thread of the pool take chunks of elements
+from a shared cursor, each in a VM of its own. Each sizes its next chunk to take about
+PFOR_CHUNK_NS by the time per element its last chunk took, but to no more than a share of
+what is left, so that the threads finish together. */
+#define PFOR_CHUNK_NS 200000
+
+typedef struct {
+	vm *v;
+	char *array;
+	size_t width, count, pc, next;
+	unsigned threads;
+	int err;
+	char err_extra[ERR_EXTRA_LEN];
+} pfor_job;
+
+typedef struct {
+	sched_task t;
+	pfor_job *job;
+} pfor_task;
+
+/* Runs the routine on element i in c; returns an error, or 0 having written it back. */
+int __pfor_elem(pfor_job *j, vm *c, const size_t i) {
+	char *elem = j->array + i*j->width;
+	int err;
+	c->ret_head = c->loop_depth = 0;
+	c->str_count = c->str_hint = c->str_lwm = 0;
+	memcpy(c->data.data, elem, j->width);
+	c->data.head = j->width;
+	if( (err = exec(c)) )												return err;
+	if( c->data.head != j->width ) {
+		sprintf(c->err_extra, "PFOR left %lu of %lu bytes", c->data.head, j->width);
+		return c->data.head < j->width ? RERR_SUNDERFLOW : RERR_SOVERFLOW;
+	}
+	memcpy(elem, c->data.data, j->width);
+	return 0;
+}
+
+void __pfor_run(pfor_job *j) {
+	vm *c = __task_vm(j->v, j->pc);
+	struct timespec t0, t1;
+	size_t chunk = 1, from, i;
+	int err = 0, none = 0;
+	while( !err && (from = __atomic_fetch_add(&j->next, chunk, __ATOMIC_RELAXED)) < j->count ) {
+		const size_t to = from + chunk < j->count ? from + chunk : j->count;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for( i = from; !err && i < to; i++ ) err = __pfor_elem(j, c, i);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		const size_t ns = (t1.tv_sec - t0.tv_sec)*1000000000UL + t1.tv_nsec - t0.tv_nsec;
+		const size_t next = __atomic_load_n(&j->next, __ATOMIC_RELAXED);
+		const size_t share = next < j->count ? (j->count - next) / (2*j->threads) : 0;
+		chunk = PFOR_CHUNK_NS / (ns / (to - from) + 1);
+		if( chunk > share ) chunk = share;
+		if( chunk == 0 ) chunk = 1;
+	}
+	if( err && __atomic_compare_exchange_n(&j->err, &none, err, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ) {
+		snprintf(j->err_extra, ERR_EXTRA_LEN, "%.27s, element %u", c->err_extra, (unsigned) (i - 1));
+		__atomic_store_n(&j->next, j->count, __ATOMIC_RELAXED);
+	}
+	polish_destroy(c);
+}
+
+void __pfor_task_run(sched_task *t) {
+	__pfor_run(((pfor_task*) t)->job);
+	sched_done(t);
+}
+
+int do_pfor(vm *v, const size_t prog_size, const size_t prog_p) {
+	t_lnum addr = 0, count = 0, width = 0, array = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	if( (RERR = pop_bargs(v, &width, &count, 4)) )						return RERR;
+	if( (RERR = pop_num(v, &array, 8)) )								return RERR;
+	if( addr >= prog_size ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "PFOR @ PP %lu to %lu", prog_p, addr);	return RERR_INV_JMP;
+	}
+	if( width == 0 || width >= STACK_SIZE ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "PFOR of %lu byte elements", width);	return RERR_SOVERFLOW;
+	}
+	if( count == 0 )													return 0;
+	pfor_job j = { v, (char*) array, width, count, addr, 0, sched_size(), 0, {0} };
+	const unsigned helpers = count < j.threads ? count - 1 : j.threads - 1;
+	pfor_task *tasks = malloc(helpers*sizeof(pfor_task));
+	__heap_share(v);
+	for( unsigned k = 0; k < helpers; k++ ) {
+		tasks[k] = (pfor_task) { { __pfor_task_run, 0 }, &j };
+		sched_spawn(&tasks[k].t);
+	}
+	__pfor_run(&j);
+	for( unsigned k = 0; k < helpers; k++ ) sched_wait(&tasks[k].t);
+	free(tasks);
+	if( j.err ) memcpy(v->err_extra, j.err_extra, ERR_EXTRA_LEN);
+	return j.err;
+}
+
+/* A channel is a block of the heap, which cls frees once no task uses it. */
+int do_chan(vm *v, const size_t prog_p) {
+	t_lnum cap = 0, width = 0;
+	chan *c;
+	int RERR;
+	if( (RERR = pop_bargs(v, &cap, &width, 4)) )						return RERR;
+	if( !cap || width >= STACK_SIZE ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "CHAN of %lu slots of %lu bytes", cap, width);	return RERR_CHAN;
+	}
+	if( v->heap_lock ) pthread_mutex_lock(v->heap_lock);
+	c = heap_alloc(v->heap, chan_size(cap, width), prog_p);
+	if( v->heap_lock ) pthread_mutex_unlock(v->heap_lock);
+	if( !c ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "CHAN @ PP %lu", prog_p);			return RERR_NOMEM;
+	}
+	chan_init(c, cap, width);
+	return push_num(v, (t_lnum) c, 8);
+}
+
+int do_send(vm *v) {
+	stack *s = &v->data;
+	t_lnum addr = 0, n = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	if( (RERR = pop_num(v, &n, 4)) )									return RERR;
+	chan *c = (chan*) addr;
+	if( n > s->head ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "SEND of %u bytes, SP @ %u", (unsigned) n, (unsigned) s->head);	return RERR_SUNDERFLOW;
+	}
+	if( n > c->width ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "SEND of %u bytes, width %u", (unsigned) n, (unsigned) c->width);	return RERR_CHAN;
+	}
+	s->head -= n;
+	str_touch(v, s->head);
+	if( chan_send(c, s->data + s->head, n) ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "SEND on a closed channel");		return RERR_CHAN;
+	}
+	return 0;
+}
+
+int do_recv(vm *v) {
+	stack *s = &v->data;
+	t_lnum addr = 0, len = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	chan *c = (chan*) addr;
+	if( s->head + c->width + 1 >= STACK_SIZE ) {
+		snprintf(v->err_extra, ERR_EXTRA_LEN, "RECV of %lu bytes, SP @ %lu", c->width, s->head);	return RERR_SOVERFLOW;
+	}
+	if( !chan_recv(c, s->data + s->head, &len) )						return push_num(v, 0, 1);
+	s->head += len;
+	return push_num(v, 1, 1);
+}
+
+int do_close(vm *v) {
+	t_lnum addr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )									return RERR;
+	chan_close((chan*) addr);
+	return 0;
+}
+
+int do_cond(vm *v, const size_t prog_size, size_t *prog_p) {
+	t_lnum cond = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &cond, 1)) )									return RERR;
+	if( cond ) { *prog_p = *prog_p + 1; return 0; }
+	if( *prog_p + 2 >= prog_size ) {
+		sprintf(v->err_extra, "end of program on conditional");			return RERR_INV_JMP;
+	}
+	*prog_p = *prog_p + 2;
+	return 0;
+}
+
+int do_dec(vm *v, const unsigned size) {
+	stack *s = &v->data;
+	if( s->head < size ) {
+		sprintf(v->err_extra, "DEC (size %u), SP @ %lu", size, s->head);	return RERR_SUNDERFLOW;
+	}
+	str_touch(v, s->head - size);
+	switch( size ) {
+	  case 1: --*(t_cnum*) (s->data + s->head - size); return 0;
+	  case 2: --*(t_rnum*) (s->data + s->head - size); return 0;
+	  case 4: --*(t_num*)  (s->data + s->head - size); return 0;
+	  case 8: --*(t_lnum*) (s->data + s->head - size); return 0;
+	}
+	return 0;
+}
+int do_inc(vm *v, const unsigned size) {
+	stack *s = &v->data;
+	if( s->head < size ) {
+		sprintf(v->err_extra, "INC (size %u), SP @ %lu", size, s->head);	return RERR_SUNDERFLOW;
+	}
+	str_touch(v, s->head - size);
+	switch( size ) {
+	  case 1: ++*(t_cnum*) (s->data + s->head - size); return 0;
+	  case 2: ++*(t_rnum*) (s->data + s->head - size); return 0;
+	  case 4: ++*(t_num*)  (s->data + s->head - size); return 0;
+	  case 8: ++*(t_lnum*) (s->data + s->head - size); return 0;
+	}
+	return 0;
+}
+
+int do_cmp(vm *v, const unsigned size) {
+	t_lnum lhs = 0, rhs = 0;
+#ifdef DEBUG
+	printf("comparing...\n");
+#endif
+	int RERR;
+	if( (RERR = pop_num(v, &rhs, size)) )		return RERR;
+	if( (RERR = peek_num(v, &lhs, size, size)) )return RERR;
+#ifdef DEBUG
+	printf("\t\tComparing %lu and %lu.\n", lhs, rhs);
+#endif
+	if( rhs > lhs )		push_num(v, 1, 1);
+	else if( rhs < lhs )push_num(v, (t_lnum) 0xFF, 1);
+	else				push_num(v, 0, 1);
+	return 0;
+}
+int do_not(vm *v) {
+	t_lnum cond = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &cond, 1)) )			return RERR;
+	push_num(v, !cond, 1);
+	return 0;
+}
+
+/* opn records its pc as the allocation site; with a heap cap it fails cleanly. */
+int do_alloc(vm *v, const size_t prog_p) {
+	t_lnum size = 0, ptr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &size, 4)) )			return RERR;
+	if( v->heap_lock ) pthread_mutex_lock(v->heap_lock);
+	ptr = (t_lnum) heap_alloc(v->heap, size, prog_p);
+	if( v->heap_lock ) pthread_mutex_unlock(v->heap_lock);
+	if( !ptr ) {
+		sprintf(v->err_extra, "OPN %lu @ PP %lu", size, prog_p);	return RERR_NOMEM;
+	}
+	push_num(v, ptr, 8);
+	return 0;
+}
+int do_free(vm *v) {
+	t_lnum addr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )			return RERR;
+	if( v->heap_lock ) pthread_mutex_lock(v->heap_lock);
+	heap_free(v->heap, (void*) addr);
+	if( v->heap_lock ) pthread_mutex_unlock(v->heap_lock);
+	return 0;
+}
+int do_mark(vm *v) {
+	if( v->heap_lock ) pthread_mutex_lock(v->heap_lock);
+	t_lnum level = heap_mark(v->heap);
+	if( v->heap_lock ) pthread_mutex_unlock(v->heap_lock);
+	if( level == 0 ) {
+		sprintf(v->err_extra, "%u marks", HEAP_MAX_MARKS);		return RERR_INVMARK;
+	}
+	return push_num(v, level, 8);
+}
+int do_release(vm *v) {
+	t_lnum level = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &level, 8)) )		return RERR;
+	if( v->heap_lock ) pthread_mutex_lock(v->heap_lock);
+	const int bad = level > HEAP_MAX_MARKS || heap_release(v->heap, level);
+	if( v->heap_lock ) pthread_mutex_unlock(v->heap_lock);
+	if( bad ) {
+		sprintf(v->err_extra, "RLSE %lu", level);				return RERR_INVMARK;
+	}
+	return 0;
+}
+int do_open_file(vm *v) {
+	stack *s = &v->data;
+	t_lnum mode = 0;
+	t_lnum fp = 0;
+	size_t strlen = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &mode, 1)) )			return RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )		return RERR;
+  	*(char*) (s->data + s->head) = 0; //TODO make this safe??
+	switch( mode ) {
+	  case 1:
+		fp = (t_lnum) fopen((char*) (s->data + s->head - strlen), "r");
+		if( (RERR = push_num(v, fp, 8)) )		return RERR;
+		return 0;
+	  case 2:
+		fp = (t_lnum) fopen((char*) (s->data + s->head - strlen), "w");
+		if( (RERR = push_num(v, fp, 8)) )		return RERR;
+		return 0;
+	  case 3:
+		fp = (t_lnum) fopen((char*) (s->data + s->head - strlen), "a");
+		if( (RERR = push_num(v, fp, 8)) )		return RERR;
+		return 0;
+	  case 9:
+		fp = (t_lnum) fopen((char*) (s->data + s->head - strlen), "r+");
+		if( (RERR = push_num(v, fp, 8)) )		return RERR;
+		return 0;
+	  case 10:
+		fp = (t_lnum) fopen((char*) (s->data + s->head - strlen), "w+");
+		if( (RERR = push_num(v, fp, 8)) )		return RERR;
+		return 0;
+	  case 11:
+		fp = (t_lnum) fopen((char*) (s->data + s->head - strlen), "a+");
+		if( (RERR = push_num(v, fp, 8)) )		return RERR;
+		return 0;
+	  default:
+		if( (RERR = push_num(v, 0, 8)) )		return RERR;
+		return 0;
+	}
+}
+int do_close_file(vm *v) {
+	t_lnum fp = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &fp, 8)) )			return RERR;
+	fclose((FILE*) fp);
+	return 0;
+}
+int do_put(vm *v, const unsigned size) {
+	t_lnum num = 0, addr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &num, size)) )		return RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )			return RERR;
+	switch( size ) {
+	  case 1: *(t_cnum*) addr = num;			return 0;
+	  case 2: *(t_rnum*) addr = num;			return 0;
+	  case 4: *(t_num*)  addr = num;			return 0;
+	  case 8: *(t_lnum*) addr = num;			return 0;
+	}
+	return 0;
+}
+
+int do_get(vm *v, const unsigned size) {
+	t_lnum addr = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &addr, 8)) )			return RERR;
+	switch( size ) {
+	  case 1: push_num(v, *(t_cnum*) addr, size);	return 0;
+	  case 2: push_num(v, *(t_rnum*) addr, size);	return 0;
+	  case 4: push_num(v, *(t_num*)  addr, size);	return 0;
+	  case 8: push_num(v, *(t_lnum*) addr, size);	return 0;
+	}
+	return 0;
+}
+
+/* The bulk memory operations take their count last, as an I, and leave the work
+to the C library's memmove, memset and memcmp. */
+int do_mcpy(vm *v) {
+	t_lnum n = 0, src = 0, dst = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &n, 4)) )			return RERR;
+	if( (RERR = pop_num(v, &src, 8)) )			return RERR;
+	if( (RERR = pop_num(v, &dst, 8)) )			return RERR;
+	memmove((void*) dst, (void*) src, n);
+	return 0;
+}
+
+int do_mset(vm *v) {
+	t_lnum n = 0, c = 0, dst = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &n, 4)) )			return RERR;
+	if( (RERR = pop_num(v, &c, 1)) )			return RERR;
+	if( (RERR = pop_num(v, &dst, 8)) )			return RERR;
+	memset((void*) dst, (int) c, n);
+	return 0;
+}
+
+int do_mcmp(vm *v) {
+	t_lnum n = 0, rhs = 0, lhs = 0;
+	int RERR, cmp;
+	if( (RERR = pop_num(v, &n, 4)) )			return RERR;
+	if( (RERR = pop_bargs(v, &lhs, &rhs, 8)) )	return RERR;
+	cmp = memcmp((void*) rhs, (void*) lhs, n);
+	if( cmp > 0 )		push_num(v, 1, 1);
+	else if( cmp < 0 )	push_num(v, (t_lnum) 0xFF, 1);
+	else				push_num(v, 0, 1);
+	return 0;
+}
+
+int do_mget(vm *v) {
+	stack *s = &v->data;
+	t_lnum n = 0, src = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &n, 4)) )			return RERR;
+	if( (RERR = pop_num(v, &src, 8)) )			return RERR;
+	if( s->head + n >= STACK_SIZE ) {
+		sprintf(v->err_extra, "MGET %lu bytes", n);				return RERR_SOVERFLOW;
+	}
+	memcpy(s->data + s->head, (void*) src, n);
+	s->head += n;
+	return 0;
+}
+
+int do_mput(vm *v) {
+	stack *s = &v->data;
+	t_lnum n = 0, dst = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &n, 4)) )			return RERR;
+	if( s->head < n + 8 ) {
+		sprintf(v->err_extra, "MPUT %lu bytes, SP @ %lu", n, s->head);	return RERR_SUNDERFLOW;
+	}
+	s->head -= n + 8;
+	str_touch(v, s->head);
+	memcpy(&dst, s->data + s->head, 8);
+	memcpy((void*) dst, s->data + s->head + 8, n);
+	return 0;
+}
+
+/* The vector operations are laid out in rows of c, r, i and l, so that the row of
+the instruction picks the kernel and the column the log2 of the element size. */
+int do_vec(vm *v, const t_instr instr) {
+	const unsigned row = (T_CVADD - instr) >> 2, w = (T_CVADD - instr) & 3;
+	t_lnum n = 0, src = 0, dst = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &n, 4)) )			return RERR;
+	if( (RERR = pop_num(v, &src, 8)) )			return RERR;
+	if( row > VEC_CMP )							return push_num(v, vec_reduce[row - VEC_CMP - 1][w]((void*) src, n), 1 << w);
+	if( (RERR = pop_num(v, &dst, 8)) )			return RERR;
+	vec_binop[row][w]((void*) dst, (void*) src, n);
+	return 0;
+}
+
+int do_sgetf(vm *v) {
+	stack *s = &v->data;
+	t_lnum fp = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &fp, 8)) )				return RERR;
+	if( (RERR = push_num(v, 0, 1)) )				return RERR;
+	int maxcnt = STACK_SIZE - s->head--;
+	*(char*) (s->data + s->head) = 0; // TODO: write fgets equivalent by hand that gives num bytes gotten and doesn't append 0
+	RERR = !fgets((char*) (s->data + s->head + 1), maxcnt, (FILE*) fp);
+	size_t zero = s->head;
+	s->head += strlen((char*) (s->data + s->head + 1));
+	if( RERR ) return RERR_STRGET;
+	if( s->head > zero ) str_mark(v, zero, s->head);
+	return 0;
+}
+
+int do_sputf(vm *v) {
+	stack *s = &v->data;
+	t_lnum fp = 0;
+	size_t strlen = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &fp, 8)) )				return RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )			return RERR;
+#ifdef DEBUG
+	printf("\t\tStr length: %lu\n", strlen);
+#endif
+	s->head -= strlen + 1;
+	str_touch(v, s->head);
+	for( unsigned i = 1; i <= strlen; i++ )
+		fputc(*(char*) (s->data + s->head + i), (FILE*) fp);
+	fputc(0, (FILE*) fp);
+	return 0;
+}
+
+int do_sdrp(vm *v) {
+	stack *s = &v->data;
+	int RERR;
+	size_t strlen;
+	if( (RERR = find_str(v, 0, &strlen)) ) 				return RERR;
+	s->head -= strlen + 1;
+	str_touch(v, s->head);
+	return 0;
+}
+
+int do_sswp(vm *v) {
+	stack *s = &v->data;
+	size_t top = 0, low = 0;
+	int RERR;
+	if( (RERR = find_str(v, 0, &top)) )					return RERR;
+	if( (RERR = find_str(v, top + 1, &low)) )			return RERR;
+	if( s->head + top + 1 >= STACK_SIZE ) {
+		sprintf(v->err_extra, "SSWP (sizes %lu, %lu)", low, top);	return RERR_SOVERFLOW;
+	}
+	size_t base = s->head - top - low - 2;
+	memcpy(s->data + s->head, s->data + s->head - top - 1, top + 1);
+	memmove(s->data + base + top + 1, s->data + base, low + 1);
+	memcpy(s->data + base, s->data + s->head, top + 1);
+	str_mark(v, base, base + top + 1);
+	str_mark(v, base + top + 1, s->head);
+	return 0;
+}
+
+int do_srev(vm *v) {
+	stack *s = &v->data;
+	size_t strlen = 0;
+	int RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )				return RERR;
+	str_rev(s->data + s->head - strlen, strlen);
+	return 0;
+}
+
+int do_ssub(vm *v) {
+	stack *s = &v->data;
+	t_lnum start = 0, len = 0;
+	size_t strlen = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &len, 4)) )					return RERR;
+	if( (RERR = pop_num(v, &start, 4)) )				return RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )				return RERR;
+	if( start > strlen )		start = strlen;
+	if( len > strlen - start )	len = strlen - start;
+	memmove(s->data + s->head - strlen, s->data + s->head - strlen + start, len);
+	s->head -= strlen - len;
+	str_mark(v, s->head - len - 1, s->head);
+	return 0;
+}
+
+int do_sdup(vm *v) {
+	stack *s = &v->data;
+	size_t strlen = 0;
+	int RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )				return RERR;
+	if( s->head + strlen + 1 >= STACK_SIZE ) {
+		sprintf(v->err_extra, "SDUP (size %lu)", strlen);			return RERR_SOVERFLOW;
+	}
+	memcpy(s->data + s->head, s->data + s->head - strlen - 1, strlen + 1);
+	s->head += strlen + 1;
+	str_mark(v, s->head - strlen - 1, s->head);
+	return 0;
+}
+
+int do_scmp(vm *v) {
+	stack *s = &v->data;
+	size_t rhs = 0, lhs = 0;
+	int RERR, cmp;
+	if( (RERR = find_str(v, 0, &rhs)) )					return RERR;
+	if( (RERR = find_str(v, rhs + 1, &lhs)) )			return RERR;
+	cmp = str_cmp(s->data + s->head - rhs, s->data + s->head - rhs - lhs - 1, rhs < lhs ? rhs : lhs);
+	if( cmp == 0 ) cmp = (rhs > lhs) - (rhs < lhs);
+	s->head -= rhs + 1;
+	str_touch(v, s->head);
+	if( cmp > 0 )		push_num(v, 1, 1);
+	else if( cmp < 0 )	push_num(v, (t_lnum) 0xFF, 1);
+	else				push_num(v, 0, 1);
+	return 0;
+}
+
+int do_scase(vm *v, void (*map)(char*, size_t)) {
+	stack *s = &v->data;
+	size_t strlen = 0;
+	int RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )				return RERR;
+	map(s->data + s->head - strlen, strlen);
+	return 0;
+}
+
+/* Splits the string at the first occurrence of the delimiter by overwriting it
+with a zero, leaving the token below and the rest of the string on top;
+if the delimiter does not occur, the rest is the empty string. */
+int do_stok(vm *v) {
+	stack *s = &v->data;
+	t_lnum delim = 0;
+	size_t strlen = 0;
+	long at;
+	int RERR;
+	if( (RERR = pop_num(v, &delim, 1)) )				return RERR;
+	if( (RERR = find_str(v, 0, &strlen)) )				return RERR;
+	at = str_chr(s->data + s->head - strlen, strlen, (char) delim);
+	if( at >= 0 ) {
+		*(char*) (s->data + s->head - strlen + at) = 0;
+		str_mark(v, s->head - strlen + at, s->head);	return 0;
+	}
+	if( (RERR = push_num(v, 0, 1)) )					return RERR;
+	str_mark(v, s->head - 1, s->head);
+	return 0;
+}
+
+/* Formats the directive tok, lexed into l, into out at *outlen, taking its argument
+from below *baseptr; any other tok is a literal character. */
+int sfmt_field(vm *v, fmt_lex *l, const int tok, size_t *baseptr, char *out, size_t *outlen, const size_t outcap) {
+	stack *s = &v->data;
+	int RERR;
+	t_lnum numval = 0;
+	unsigned width = 0, digits;
+	char prefix = 0;
+	size_t count = 0, fieldlen;
+	switch( tok ) {
+	  case FMT_CHAR: case FMT_RED: case FMT_INT: case FMT_LONG: {
+		const unsigned size = 1 << (FMT_CHAR - tok);
+#ifdef DEBUG
+		printf("\t\tFound %%%c\n", "cril"[FMT_CHAR - tok]);
+#endif
+		if( (RERR = peek_num(v, &numval, s->head - *baseptr + size, size)) )	return RERR;
+		*baseptr -= size;
+		width = fmt_num_width_prep(l, &numval, size, &digits, &prefix);
+		fieldlen = width > (unsigned) l->width ? width : (unsigned) l->width;
+		if( *outlen + fieldlen > outcap ) break;
+		fmt_num(l, out + *outlen, numval, width, digits, prefix);
+		*outlen += fieldlen;
+		return 0;
+	  }
+	  case FMT_STR:
+#ifdef DEBUG
+		printf("\t\tFound %%s\n");
+#endif
+		if( (RERR = find_str(v, s->head - *baseptr, &count)) )				return RERR;
+		*baseptr -= count + 1;
+		fieldlen = l->width == -1 || count > (unsigned) l->width ? count : (unsigned) l->width;
+		if( *outlen + fieldlen > outcap ) break;
+		memset(out + *outlen, ' ', fieldlen - count);
+		memcpy(out + *outlen + fieldlen - count, s->data + *baseptr + 1, count);
+		*outlen += fieldlen;
+		return 0;
+	  case FMT_INV:															return RERR_INVFMT;
+	  default:
+		fieldlen = 1;
+		if( *outlen == outcap ) break;
+		out[(*outlen)++] = tok;
+		return 0;
+	}
+	sprintf(v->err_extra, "SFMT (%lu bytes)", *outlen + fieldlen);				return RERR_SOVERFLOW;
+}
+
+int do_sformat(vm *v) {
+	stack *s = &v->data;
+	int RERR;
+	size_t count = 0, outlen = 0;
+	if( (RERR = find_str(v, 0, &count)) )									return RERR;
+#ifdef DEBUG
+	printf("\t\tFormat str length: %lu\n", count);
+#endif
+	const size_t fmtzero = s->head - count - 1, outcap = STACK_SIZE - fmtzero - 1;
+	size_t baseptr = fmtzero;
+	const char *fmtend = s->data + s->head;
+	*(char*) (s->data + s->head) = 0;
+	fmt_lex l = make_fmt_lex((char*) (s->data + fmtzero + 1));
+	while( l.c < fmtend )
+		if( (RERR = sfmt_field(v, &l, next_token_fmt(&l), &baseptr, v->fmt_scratch, &outlen, outcap)) ) return RERR;
+	memcpy(s->data + fmtzero + 1, v->fmt_scratch, outlen);
+	s->head = fmtzero + 1 + outlen;
+	str_mark(v, fmtzero, s->head);
+	return 0;
+}
+
+/* Pops the I offset of a compiled format and points prog at it. */
+int fmt_prog_at(vm *v, const char **prog) {
+	t_lnum offset = 0;
+	int RERR;
+	if( (RERR = pop_num(v, &offset, 4)) )									return RERR;
+	if( offset + sizeof(fmt_op) > v->prog->sections[PBC_SEC_FMT].size ) {
+		sprintf(v->err_extra, "compiled format @ %lu", offset);				return RERR_INVFMT;
+	}
+	*prog = v->prog->sections[PBC_SEC_FMT].data + offset;
+	return 0;
+}
+
+/* sfmtp is sfmt with a format compiled by polishc instead of a format string on the
+stack: nothing is lexed, literal runs are copied whole, and as the arguments all lie
+below the head the result is written in place above them. */
+int do_sformat_prog(vm *v) {
+	stack *s = &v->data;
+	const char *prog = 0;
+	fmt_op op;
+	fmt_lex l;
+	int RERR;
+	if( (RERR = fmt_prog_at(v, &prog)) )									return RERR;
+	const size_t zero = s->head, outcap = STACK_SIZE - zero - 1;
+	size_t baseptr = zero, outlen = 0;
+	char *out = s->data + zero + 1;
+	for( ; memcpy(&op, prog, sizeof(op)), op.tok != FMT_END; prog += sizeof(op) ) {
+		if( op.tok == FMT_LIT ) {
+			if( outlen + op.width > outcap ) {
+				sprintf(v->err_extra, "SFMT (%lu bytes)", outlen + op.width);	return RERR_SOVERFLOW;
+			}
+			memcpy(out + outlen, prog + sizeof(op), op.width);
+			outlen += op.width;
+			prog += FMT_LIT_SIZE(op.width);
+			continue;
+		}
+		l = (fmt_lex) { 0, 0, op.sign, op.base, op.padding, op.width };
+		if( (RERR = sfmt_field(v, &l, op.tok, &baseptr, out, &outlen, outcap)) ) return RERR;
+	}
+	*(char*) (s->data + zero) = 0;
+	s->head = zero + 1 + outlen;
+	str_mark(v, zero, s->head);
+	return 0;
+}
+
+/* Reads the directive tok, lexed into l, from *in into fmt_scratch at *outlen;
+returns -1 if the input does not match it. */
+int sscn_field(vm *v, fmt_lex *l, const int tok, const char **in, const char *inend, size_t *outlen, const size_t outcap) {
+	t_lnum numval = 0;
+	size_t count, size;
+	if( tok == FMT_STR ) {
+#ifdef DEBUG
+		printf("\t\tFound %%s\n");
+#endif
+		if( l->width == -1 ) for( count = 0; *in + count < inend && !isspace((*in)[count]); count++ );
+		else if( inend - *in >= l->width ) count = l->width;
+		else																return -1;
+		if( count == 0 )													return -1;
+		if( (size = count + 1) > outcap - *outlen )							goto overflow;
+		v->fmt_scratch[*outlen] = 0;
+		memcpy(v->fmt_scratch + *outlen + 1, *in, count);
+		*in += count;
+	} else {
+		size = 1 << (FMT_CHAR - tok);
+#ifdef DEBUG
+		printf("\t\tFound %%%c\n", "cril"[FMT_CHAR - tok]);
+#endif
+		if( fparse_num(l, in, inend, &numval) )								return -1;
+		if( size > outcap - *outlen )										goto overflow;
+		memcpy(v->fmt_scratch + *outlen, &numval, size);
+	}
+	*outlen += size;
+	return 0;
+  overflow:
+	sprintf(v->err_extra, "SSCN (%lu bytes)", *outlen + size);				return RERR_SOVERFLOW;
+}
+
+/* Replaces the input string at strzero, and anything above it, with the values read. */
+int sscn_finish(vm *v, const size_t strzero, const size_t outlen, const t_cnum filled) {
+	stack *s = &v->data;
+	if( outlen + 1 > STACK_SIZE - strzero - 1 ) {
+		sprintf(v->err_extra, "SSCN (%lu bytes at %lu)", outlen, strzero);	return RERR_SOVERFLOW;
+	}
+	memcpy(s->data + strzero, v->fmt_scratch, outlen);
+	s->head = strzero + outlen;
+	str_touch(v, strzero);
+	push_num(v, filled, 1);
+	return 0;
+}
+
+/* sscn matches the string below it against the format string on top, replacing both
+with the values of the directives it filled, in order, and a character holding their
+number; it stops at the first directive or character of the format which does not match.
+%s reads the next run of non-space characters, or exactly its width, as a string;
+whitespace in the format matches any amount of whitespace, including none. */
+int do_sscan(vm *v) {
+	stack *s = &v->data;
+	int RERR, tok;
+	size_t fmtcount = 0, strcount = 0, outlen = 0;
+	t_cnum filled = 0;
+	if( (RERR = find_str(v, 0, &fmtcount)) )								return RERR;
+#ifdef DEBUG
+	printf("\t\tFormat str length: %lu\n", fmtcount);
+#endif
+	if( (RERR = find_str(v, fmtcount + 1, &strcount)) )						return RERR;
+	const size_t fmtzero = s->head - fmtcount - 1, strzero = fmtzero - strcount - 1;
+	const size_t outcap = STACK_SIZE - strzero - 1;
+	const char *in = s->data + strzero + 1, *inend = s->data + fmtzero, *fmtend = s->data + s->head;
+	*(char*) (s->data + s->head) = 0;
+	fmt_lex l = make_fmt_lex((char*) (s->data + fmtzero + 1));
+	while( l.c < fmtend ) {
+		tok = next_token_fmt(&l);
+		switch( tok ) {
+		  case FMT_CHAR: case FMT_RED: case FMT_INT: case FMT_LONG: case FMT_STR:
+			if( (RERR = sscn_field(v, &l, tok, &in, inend, &outlen, outcap)) < 0 ) goto done;
+			if( RERR )														return RERR;
+			filled++;
+			continue;
+		  case FMT_INV:														return RERR_INVFMT;
+		  default:
+			if( isspace(tok) )		while( in < inend && isspace(*in) ) in++;
+			else if( in < inend && *in == tok ) in++;
+			else															goto done;
+		}
+	}
+  done:
+	return sscn_finish(v, strzero, outlen, filled);
+}
+
+/* sscnp is sscn with a format compiled by polishc; literal runs are compared whole. */
+int do_sscan_prog(vm *v) {
+	stack *s = &v->data;
+	const char *prog = 0;
+	size_t strcount = 0, outlen = 0;
+	t_cnum filled = 0;
+	fmt_op op;
+	fmt_lex l;
+	int RERR;
+	if( (RERR = fmt_prog_at(v, &prog)) )									return RERR;
+	if( (RERR = find_str(v, 0, &strcount)) )								return RERR;
+	const size_t strzero = s->head - strcount - 1, outcap = STACK_SIZE - strzero - 1;
+	const char *in = s->data + strzero + 1, *inend = s->data + s->head;
+	for( ; memcpy(&op, prog, sizeof(op)), op.tok != FMT_END; prog += sizeof(op) ) {
+		switch( op.tok ) {
+		  case FMT_LIT:
+			if( inend - in < op.width || memcmp(in, prog + sizeof(op), op.width) ) goto done;
+			in += op.width;
+			prog += FMT_LIT_SIZE(op.width);
+			continue;
+		  case FMT_WS:
+			while( in < inend && isspace(*in) ) in++;
+			continue;
+		  default:
+			l = (fmt_lex) { 0, 0, op.sign, op.base, op.padding, op.width };
+			if( (RERR = sscn_field(v, &l, op.tok, &in, inend, &outlen, outcap)) < 0 ) goto done;
+			if( RERR )														return RERR;
+			filled++;
+		}
+	}
+  done:
+	return sscn_finish(v, strzero, outlen, filled);
+}
+
+int exec(vm *v) {
+	const stack *prog_stack = &v->prog->code;
+	size_t prog_p		= v->pc;
+	int err				= 0;
+	short magic			= 0;
+	t_instr instr		= 0;
+	t_lnum save			= 0;
+	size_t from			= 0;
+	t_lnum val			= 0;
+	unsigned char under = 0;
+	t_rnum bytes		= *(t_rnum*) (prog_stack->data + INSTR_SIZE*prog_p);
+	magic		= (t_rnum)		bytes & MASK_MAGIC;
+	instr		= (t_instr) 	bytes & MASK_DATA;
+#ifdef DEBUG
+	printf("--------------------------------\n");
+	printf("\t\tEXECUTING\t\t\n");
+#endif
+	for(;;) {
+#ifdef SHOWSTACK
+		printf("Program pointer at %lu ", prog_p);
+		char buff[32] = {0};
+		sprint_instr(buff, prog_stack->data + prog_p*INSTR_SIZE);
+		printf("%s\n", buff);
+#endif
+		if( magic & MAGIC_CONT ) {
+			sprintf(v->err_extra, "%04X @ PP %lu", magic, prog_p);					return RERR_UNEXP_CONT;
+		} else if ( magic ) {
+			val = 0;
+			err = get_num(prog_stack->data + prog_p*INSTR_SIZE, magic, &val);
+			if( err ) { memcpy(v->err_extra, err_extra, ERR_EXTRA_LEN); return err; }
+			prog_p += MAGIC_TO_SIZE(magic);
+			err = push_num(v, val, MAGIC_TO_SIZE(magic));
+			if( err ) return err;
+			if( v->str_track && magic == MAGIC_CHAR ) str_push_char(v, val);
+		} else {
+			switch( instr ) {
+			  case 0:
+				sprintf(v->err_extra, "EOF @ PP %lu", prog_p);						return ERR_EOF;
+			  case T_CADD:
+				if( (err = do_add(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RADD:
+				if( (err = do_add(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_ADD:
+				if( (err = do_add(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LADD:
+				if( (err = do_add(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_CSUB:
+				if( (err = do_sub(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RSUB:
+				if( (err = do_sub(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_SUB:
+				if( (err = do_sub(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LSUB:
+				if( (err = do_sub(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_CMUL:
+				if( (err = do_mul(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RMUL:
+				if( (err = do_mul(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_MUL:
+				if( (err = do_mul(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LMUL:
+				if( (err = do_mul(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_CDIV:
+				if( (err = do_div(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RDIV:
+				if( (err = do_div(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_DIV:
+				if( (err = do_div(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LDIV:
+				if( (err = do_div(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_CSWP:
+				if( (err = do_swp(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RSWP:
+				if( (err = do_swp(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_SWP:
+				if( (err = do_swp(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LSWP:
+				if( (err = do_swp(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_CDUP:
+				if( (err = do_dup(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RDUP:
+				if( (err = do_dup(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_DUP:
+				if( (err = do_dup(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LDUP:
+				if( (err = do_dup(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_JMP:
+				from = prog_p;
+				if( (err = do_jmp(v, prog_stack->head, &prog_p)) )  { return err; }
+				if( prog_p <= from && !under && slice_spent(v, from - prog_p + 1) ) { v->pc = prog_p; return POLISH_SUSPENDED; }
+				break;
+			  case T_CALL:
+				if( (err = do_call(v, prog_stack->head, &prog_p)) ) { return err; } break;
+			  case T_RET:
+				if( (err = do_ret(v, &prog_p)) ) { return err; } break;
+			  case T_LOOP:
+				if( (err = do_loop(v, prog_p)) ) { return err; } prog_p++; break;
+			  case T_NEXT:
+				from = prog_p;
+				if( (err = do_next(v, &prog_p)) ) { return err; }
+				if( prog_p < from && !under && slice_spent(v, from - prog_p + 1) ) { v->pc = prog_p; return POLISH_SUSPENDED; }
+				break;
+			  case T_INDEX:
+				if( (err = do_index(v, prog_p)) ) { return err; } prog_p++; break;
+			  case T_SPAWN:
+				if( (err = do_spawn(v, prog_stack->head, prog_p)) ) { return err; } prog_p++; break;
+			  case T_JOIN:
+				if( (err = do_join(v)) ) { return err; } prog_p++; break;
+			  case T_PFOR:
+				if( (err = do_pfor(v, prog_stack->head, prog_p)) ) { return err; } prog_p++; break;
+			  case T_CHAN:
+				if( (err = do_chan(v, prog_p)) ) { return err; } prog_p++; break;
+			  case T_SEND:
+				if( (err = do_send(v)) ) { return err; } prog_p++; break;
+			  case T_RECV:
+				if( (err = do_recv(v)) ) { return err; } prog_p++; break;
+			  case T_CLOSE:
+				if( (err = do_close(v)) ) { return err; } prog_p++; break;
+			  case '?':
+			 	if( (err = do_cond(v, prog_stack->head, &prog_p)) ) { return err; } break;
+			  case T_CDEC:
+				if( (err = do_dec(v, 1)) )		{ return err; }			prog_p++; break;
+			  case T_RDEC:
+				if( (err = do_dec(v, 2)) )		{ return err; }			prog_p++; break;
+			  case T_DEC:
+				if( (err = do_dec(v, 4)) )		{ return err; }			prog_p++; break;
+			  case T_LDEC:
+				if( (err = do_dec(v, 8)) )		{ return err; }			prog_p++; break;
+			  case T_CINC:
+				if( (err = do_inc(v, 1)) )		{ return err; }			prog_p++; break;
+			  case T_RINC:
+				if( (err = do_inc(v, 2)) )		{ return err; }			prog_p++; break;
+			  case T_INC:
+				if( (err = do_inc(v, 4)) )		{ return err; }			prog_p++; break;
+			  case T_LINC:
+				if( (err = do_inc(v, 8)) )		{ return err; }			prog_p++; break;
+			  case T_CUND:
+				if( (err = pop_num(v, &save, 1)) ) { return err; } under = 1; prog_p++; goto next;
+			  case T_RUND:
+				if( (err = pop_num(v, &save, 2)) ) { return err; } under = 2; prog_p++; goto next;
+			  case T_UND:
+				if( (err = pop_num(v, &save, 4)) ) { return err; } under = 4; prog_p++; goto next;
+			  case T_LUND:
+				if( (err = pop_num(v, &save, 8)) ) { return err; } under = 8; prog_p++; goto next;
+			  case T_CCMP:
+				if( (err = do_cmp(v, 1)) )		{ return err; }			prog_p++; break;
+			  case T_RCMP:
+				if( (err = do_cmp(v, 2)) )		{ return err; }			prog_p++; break;
+			  case T_CMP:
+				if( (err = do_cmp(v, 4)) )		{ return err; }			prog_p++; break;
+			  case T_LCMP:
+				if( (err = do_cmp(v, 8)) )		{ return err; }			prog_p++; break;
+			  case '!':
+				if( (err = do_not(v)) )		{ return err; }			prog_p++; break;
+			  case T_CDRP:
+				if( (err = pop_num(v, 0, 1)) ) { return err; }			prog_p++; break;
+			  case T_RDRP:
+				if( (err = pop_num(v, 0, 2)) ) { return err; }			prog_p++; break;
+			  case T_DRP:
+				if( (err = pop_num(v, 0, 4)) ) { return err; }			prog_p++; break;
+			  case T_LDRP:
+				if( (err = pop_num(v, 0, 8)) ) { return err; }			prog_p++; break;
+			  case T_OPN:
+			 	if( (err = do_alloc(v, prog_p)) ) { return err; }		prog_p++; break;
+			  case T_CLS:
+				if( (err = do_free(v)) )		{ return err; }			prog_p++; break;
+			  case T_MARK:
+				if( (err = do_mark(v)) )		{ return err; }			prog_p++; break;
+			  case T_RLSE:
+				if( (err = do_release(v)) )	{ return err; }			prog_p++; break;
+			  case T_MCPY:
+				if( (err = do_mcpy(v)) )		{ return err; }			prog_p++; break;
+			  case T_MSET:
+				if( (err = do_mset(v)) )		{ return err; }			prog_p++; break;
+			  case T_MCMP:
+				if( (err = do_mcmp(v)) )		{ return err; }			prog_p++; break;
+			  case T_MGET:
+				if( (err = do_mget(v)) )		{ return err; }			prog_p++; break;
+			  case T_MPUT:
+				if( (err = do_mput(v)) )		{ return err; }			prog_p++; break;
+			  case T_CVADD: case T_RVADD: case T_VADD: case T_LVADD:
+			  case T_CVSUB: case T_RVSUB: case T_VSUB: case T_LVSUB:
+			  case T_CVMUL: case T_RVMUL: case T_VMUL: case T_LVMUL:
+			  case T_CVCMP: case T_RVCMP: case T_VCMP: case T_LVCMP:
+			  case T_CVSUM: case T_RVSUM: case T_VSUM: case T_LVSUM:
+			  case T_CVMIN: case T_RVMIN: case T_VMIN: case T_LVMIN:
+			  case T_CVMAX: case T_RVMAX: case T_VMAX: case T_LVMAX:
+				if( (err = do_vec(v, instr)) )	{ return err; }			prog_p++; break;
+			  case T_OPNF:
+			 	if( (err = do_open_file(v)) )	{ return err; }			prog_p++; break;
+			  case T_CLSF:
+				if( (err = do_close_file(v)) ) { return err; }			prog_p++; break;
+			  case T_CPUT:
+				if( (err = do_put(v, 1)) )		{ return err; }			prog_p++; break;
+			  case T_RPUT:
+				if( (err = do_put(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_PUT:
+				if( (err = do_put(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LPUT:
+				if( (err = do_put(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_CGET:
+				if( (err = do_get(v, 1)) ) 	{ return err; }			prog_p++; break;
+			  case T_RGET:
+				if( (err = do_get(v, 2)) ) 	{ return err; }			prog_p++; break;
+			  case T_GET:
+				if( (err = do_get(v, 4)) ) 	{ return err; }			prog_p++; break;
+			  case T_LGET:
+				if( (err = do_get(v, 8)) ) 	{ return err; }			prog_p++; break;
+			  case T_IN:
+				if( (err = push_num(v, (t_lnum) v->in, 8)) )  { return err; } prog_p++; break;
+			  case T_OUT:
+				if( (err = push_num(v, (t_lnum) v->out, 8)) ) { return err; } prog_p++; break;
+			  case T_SPUTF:
+				if( !under && v->slice && v->budget-- <= 0 ) { v->pc = prog_p; return POLISH_SUSPENDED; }
+				if( (err = do_sputf(v)) )		{ return err; }			prog_p++; break;
+			  case T_SGETF:
+				if( !under && v->slice && v->budget-- <= 0 ) { v->pc = prog_p; return POLISH_SUSPENDED; }
+				if( (err = do_sgetf(v)) )		{ return err; }			prog_p++; break;
+			  case T_SFMT:
+				if( (err = do_sformat(v)) ) 	{ return err; }			prog_p++; break;
+			  case T_SSCN:
+				if( (err = do_sscan(v)) )		{ return err; }			prog_p++; break;
+			  case T_SFMTP:
+				if( (err = do_sformat_prog(v)) ) { return err; }		prog_p++; break;
+			  case T_SSCNP:
+				if( (err = do_sscan_prog(v)) )	{ return err; }			prog_p++; break;
+			  case T_SDRP:
+				if( (err = do_sdrp(v)) ) 		{ return err; } 		prog_p++; break;
+			  case T_SSWP:
+				if( (err = do_sswp(v)) )		{ return err; }			prog_p++; break;
+			  case T_SREV:
+				if( (err = do_srev(v)) )		{ return err; }			prog_p++; break;
+			  case T_SSUB:
+				if( (err = do_ssub(v)) )		{ return err; }			prog_p++; break;
+			  case T_SDUP:
+				if( (err = do_sdup(v)) )		{ return err; }			prog_p++; break;
+			  case T_SCMP:
+				if( (err = do_scmp(v)) )		{ return err; }			prog_p++; break;
+			  case T_SCAP:
+				if( (err = do_scase(v, str_upper)) ) { return err; }	prog_p++; break;
+			  case T_SLOW:
+				if( (err = do_scase(v, str_lower)) ) { return err; }	prog_p++; break;
+			  case T_STOK:
+				if( (err = do_stok(v)) )		{ return err; }			prog_p++; break;
+			  case T_END:
+			  	if( under ) {
+			  		err = push_num(v, save, under);
+			  		if( err ) return err;
+			  	} return 0;
+			}
+		}
+		if( under ) {
+			err = push_num(v, save, under);
+			under = 0;
+			if( err ) return err;
+		}
+#ifdef SHOWSTACK
+		printf("Stack state: ");
+		print_stack(v->data);
+		printf("----------------------------\n");
+#endif
+	  next:
+		bytes = *(t_rnum*) (prog_stack->data + INSTR_SIZE*prog_p);
+		magic	= (short)	bytes & MASK_MAGIC;
+		val		= (t_num)	bytes & MASK_DATA;
+		instr	= (t_instr) bytes & MASK_DATA;
+	}
+}
+
+void print_prog(stack prog_stack) {
+	char *buff = malloc(32);
+	printf("Program: \n");
+	for( size_t i = 0; i < prog_stack.head; ) {
+		i += INSTR_SIZE*sprint_instr(buff, prog_stack.data + i);
+		printf("%s", buff);
+	}
+	free(buff);
+	printf("\n");
+}
+
+/* Returns the source line pc was compiled from, if polishc -g left a line map, or 0. */
+unsigned pc_line(const polish_prog *p, const size_t pc) {
+	const pbc_section *map = p->sections + PBC_SEC_LINES;
+	size_t lo = 0, hi = map->size / sizeof(pbc_line), mid;
+	pbc_line entry = {0, 0};
+	while( lo < hi ) {
+		mid = (lo + hi) / 2;
+		memcpy(&entry, map->data + mid*sizeof(pbc_line), sizeof(pbc_line));
+		if( entry.pc <= pc )	lo = mid + 1;
+		else					hi = mid;
+	}
+	if( lo == 0 ) return 0;
+	memcpy(&entry, map->data + (lo - 1)*sizeof(pbc_line), sizeof(pbc_line));
+	return entry.line;
+}
+
+pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+void __simd_init(void) {
+	str_simd_init();
+	vec_simd_init();
+}
+
+/* Takes over the size bytes of bytecode at image, zero padded by an instruction so
+that running off the end stops at EOF. */
+polish_prog *__polish_load(char *image, const size_t size) {
+	polish_prog *p = calloc(1, sizeof(polish_prog));
+	p->code = (stack) { image, pbc_read_sections(image, size, p->sections) };
+	pthread_once(&simd_once, __simd_init);
+	return p;
+}
+
+polish_prog *polish_load_mem(const void *pbc, const size_t size) {
+	char *image = calloc(size + INSTR_SIZE, 1);
+	memcpy(image, pbc, size);
+	return __polish_load(image, size);
+}
+
+polish_prog *polish_load_file(const char *path) {
+	FILE *f = fopen(path, "r");
+	char *image;
+	long size;
+	if( !f ) return 0;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	image = calloc(size + INSTR_SIZE, 1);
+	if( size < 0 || fread(image, 1, size, f) != (size_t) size ) {
+		free(image);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	return __polish_load(image, size);
+}
+
+void polish_prog_free(polish_prog *p) {
+	if( !p ) return;
+	free(p->code.data);
+	free(p);
+}
+
+polish_vm *polish_create(const polish_prog *p) {
+	polish_vm *v = calloc(1, sizeof(polish_vm));
+	v->prog = p;
+	v->data = make_stack(STACK_SIZE);
+	v->heap = &v->own_heap;
+	v->in = stdin;
+	v->out = stdout;
+	return v;
+}
+
+void polish_set_io(polish_vm *v, FILE *in, FILE *out) {
+	v->in = in;
+	v->out = out;
+}
+
+void polish_set_strtrack(polish_vm *v, const int on) {
+	v->str_track = on;
+	if( on && !v->str_bounds ) v->str_bounds = malloc(STACK_SIZE*sizeof(str_bound));
+}
+
+void polish_set_slice(polish_vm *v, const unsigned long n) {
+	v->slice = n;
+}
+
+int polish_run(polish_vm *v) {
+	v->budget = v->slice;
+	const int err = exec(v);
+	if( err == POLISH_SUSPENDED )	return err;
+	v->pc = 0;
+	if( err )	snprintf(v->err_msg, sizeof(v->err_msg), "%s%s%s", rerr_notify, rerr_strs[err - 1], v->err_extra);
+	else		v->err_msg[0] = 0;
+	return err;
+}
+
+void polish_set_threads(const unsigned n) {
+	sched_threads = n;
+}
+
+const char *polish_error(const polish_vm *v) {
+	return v->err_msg;
+}
+
+void polish_reset(polish_vm *v) {
+	heap_destroy(v->heap);
+	v->data.head = v->ret_head = v->loop_depth = v->pc = 0;
+	v->str_count = v->str_hint = v->str_lwm = 0;
+	v->err_extra[0] = v->err_msg[0] = 0;
+}
+
+void polish_destroy(polish_vm *v) {
+	if( !v ) return;
+	if( v->heap == &v->own_heap ) {
+		heap_destroy(v->heap);
+		if( v->heap_lock ) pthread_mutex_destroy(v->heap_lock);
+		free(v->heap_lock);
+	}
+	free(v->data.data);
+	free(v->str_bounds);
+	free(v);
+}
+
+#endif //_VM_H
@@ -0,0 +1,62 @@
+#include <pthread.h>
+#include "../src/libpolish.h"
+
+/* Runs the program given on the command line in THREADS VMs at once, all sharing one
+load of it, and then once more in the first VM after a reset, in slices of a single
+instruction; prints the output of the first run and whether every run printed the same. */
+#define THREADS 8
+
+typedef struct {
+	polish_vm *v;
+	FILE *out;
+	int err;
+} run;
+
+void *run_vm(void *arg) {
+	run *r = arg;
+	r->err = polish_run(r->v);
+	return 0;
+}
+
+int same(FILE *a, FILE *b) {
+	int c;
+	rewind(a);
+	rewind(b);
+	while( (c = fgetc(a)) == fgetc(b) ) if( c == EOF ) return 1;
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	run runs[THREADS];
+	pthread_t threads[THREADS];
+	int c, err, agree = 1;
+	if( argc != 2 ) { printf("Usage: %s file.pbc\n", argv[0]); return 1; }
+	polish_prog *p = polish_load_file(argv[1]);
+	if( !p ) { printf("File %s not found.\n", argv[1]); return 1; }
+	for( int i = 0; i < THREADS; i++ ) {
+		runs[i] = (run) { polish_create(p), tmpfile(), 0 };
+		polish_set_io(runs[i].v, stdin, runs[i].out);
+		pthread_create(threads + i, 0, run_vm, runs + i);
+	}
+	for( int i = 0; i < THREADS; i++ ) {
+		pthread_join(threads[i], 0);
+		if( runs[i].err ) printf("VM %d: %s\n", i, polish_error(runs[i].v));
+		agree = agree && !runs[i].err && (i == 0 || same(runs[0].out, runs[i].out));
+	}
+	FILE *again = tmpfile();
+	polish_reset(runs[0].v);
+	polish_set_io(runs[0].v, stdin, again);
+	polish_set_slice(runs[0].v, 1);
+	while( (err = polish_run(runs[0].v)) == POLISH_SUSPENDED );
+	agree = agree && !err && same(runs[0].out, again);
+	rewind(runs[0].out);
+	while( (c = fgetc(runs[0].out)) != EOF ) putchar(c);
+	printf("%d runs %s\n", THREADS + 1, agree ? "agree" : "differ");
+	for( int i = 0; i < THREADS; i++ ) {
+		polish_destroy(runs[i].v);
+		fclose(runs[i].out);
+	}
+	fclose(again);
+	polish_prog_free(p);
+	return !agree;
+}